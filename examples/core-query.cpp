@@ -37,7 +37,13 @@ int main(int argc, char **argv)
 		} while (pos < path.length());
 		
 		vector<dwarf::core::iterator_base > results;
-		r.resolve_all_visible_from_root(split_path.begin(), split_path.end(),
+		/* A bare name can go straight to the accelerated lookup. */
+		if (split_path.size() == 1)
+		{
+			auto found = r.find_visible_named_grandchild(split_path.front());
+			if (found) results.push_back(found);
+		}
+		else r.resolve_all_visible_from_root(split_path.begin(), split_path.end(),
 			results, 1);
 		if (results.size() == 1) cout << *results.begin(); else cout << "not found!";
 		cout << endl;
@@ -4,13 +4,23 @@ sys.path.append('./spec')
 
 from dwarf3 import *
 
+# All the classes a tag's payload is an instance of: its own, plus
+# everything reachable through bases, whether real tags or artificial.
+def ancestors_or_self(name):
+    bases = tag_map.get(name, ([], [], []))[2] + artificial_tag_map.get(name, ([], [], []))[2]
+    return set([name]).union(*[ancestors_or_self(base) for base in bases])
+
 def main(argv):
-    for base in set(sum([bases for (tag, (attr, children, bases)) in tags], [])):
-        print "begin_pred(%s)" % base
-        for tag_in_pred in [tag for (tag, ( attr, children, this_tag_bases) ) in tags \
-                if base in this_tag_bases]:
-            print "\tdisjunct(%s)" % tag_in_pred
-        print "end_pred(%s)" % base
+    classes = [tag for (tag, _) in tags] + [tag for (tag, _) in artificial_tags]
+    for cls in classes:
+        # basic matches every tag, so the C++ side handles it directly
+        if cls == "basic":
+            continue
+        print "begin_pred(%s)" % cls
+        for (tag_in_pred, _) in tags:
+            if cls in ancestors_or_self(tag_in_pred):
+                print "\tdisjunct(%s)" % tag_in_pred
+        print "end_pred(%s)" % cls
 
 # main script
 if __name__ == "__main__":
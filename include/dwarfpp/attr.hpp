@@ -44,6 +44,9 @@ namespace dwarf
 		struct basic_die;
 		struct type_die;
 		template <typename DerefAs = basic_die> struct iterator_df;
+		struct native_die;
+		struct native_value;
+		struct attribute_view;
 	}
 	namespace encap
 	{
@@ -64,6 +67,7 @@ namespace dwarf
 				friend class encap::dieset;
 				friend class core::basic_die; // for use of the NO_ATTR constructor in find_attr
 				friend class core::iterator_base; // the same in iterator_base::attr()
+				friend struct core::attribute_view; // ... and for absent attributes there
 		public: 
 			struct weak_ref { 
 				friend class attribute_value;
@@ -198,6 +202,10 @@ namespace dwarf
 				root_die& r/*,
 				spec::abstract_def& = spec::DEFAULT_DWARF_SPEC*/);
 				// spec is no longer passed because it's deducible from r and d.get_offset()
+			// ... and likewise for the native reader (see native.hpp); cls is the 
+			// spec's interpretation of the attribute, which the caller has checked
+			attribute_value(const dwarf::core::native_die& d, Dwarf_Half attr,
+				const dwarf::core::native_value& v, int cls, root_die& r);
 		public:
 			attribute_value(spec::abstract_dieset& ds, const dwarf::lib::attribute& a);
 			attribute_value(spec::abstract_dieset& ds, Dwarf_Bool b) : p_ds(&ds), orig_form(DW_FORM_flag), f(FLAG), v_flag(b) {}
@@ -0,0 +1 @@
+../../dwarf3-tagpreds.h
\ No newline at end of file
@@ -13,11 +13,22 @@
 #include <memory>
 #include <stack>
 #include <unordered_set>
+#include <list>
 #include <unordered_map>
 #include <vector>
+#include <iterator>
 #include <queue>
+#include <algorithm>
+#include <type_traits>
+#include <typeinfo>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
 #include <cassert>
 #include <boost/optional.hpp>
+#include <boost/utility/string_view.hpp>
 #include <boost/icl/interval_map.hpp>
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/iterator/iterator_facade.hpp>
@@ -51,6 +62,7 @@ namespace dwarf
 	using std::stack;
 	using std::unordered_set;
 	using std::unordered_map;
+	using std::unordered_multimap;
 	using std::endl;
 	using std::ostream;
 	using std::cerr;
@@ -66,6 +78,7 @@ namespace dwarf
 		using std::deque;
 		using boost::optional;
 		using boost::intrusive_ptr;
+		using boost::string_view;
 		using std::dynamic_pointer_cast;
 		
 		using dwarf::spec::opt;
@@ -163,6 +176,7 @@ namespace dwarf
 		template <typename DerefAs /* = basic_die*/> struct iterator_df; // see attr.hpp
 		template <typename DerefAs = basic_die> struct iterator_bf;
 		template <typename DerefAs = basic_die> struct iterator_sibs;
+		struct iterator_grandchildren;
 		// children
 		// so how do we iterate over "children satisfying predicate, derefAs'd X"? 
 		//pair< 
@@ -175,6 +189,36 @@ namespace dwarf
 			bool operator==(const is_a_t<Payload>&) const { return true; }
 			bool operator!=(const is_a_t<Payload>&) const { return false; }
 		}; // defined below, once we have factory
+		/* Which tags make payloads of a given class? The generator tells us
+		 * (see gen-tagpreds-cpp.py), and we specialize this template for 
+		 * each spec-defined class after the generated ADT includes. Classes 
+		 * it doesn't know about fall back to dynamic_cast. */
+		template <typename Payload>
+		struct payload_tags
+		{
+			static constexpr bool known = false;
+			static constexpr bool contains(Dwarf_Half tag) { return false; }
+		};
+		/* Downcasting a payload reference. The commonest case, basic_die
+		 * itself, is free, and anything non-virtually derived gets a 
+		 * static_cast. Most DIE classes have basic_die as a virtual base,
+		 * so static_cast to them is illegal; for those, the tag tells us
+		 * which class the factory made, and we cast via that (see the 
+		 * definition, after the generated classes). */
+		template <typename To, typename = void>
+		struct can_static_downcast : std::false_type {};
+		template <typename To>
+		struct can_static_downcast<To, 
+			decltype((void) static_cast<To *>(std::declval<basic_die *>()))>
+		 : std::true_type {};
+		template <typename To>
+		inline To& downcast_payload(basic_die& arg, std::true_type /* static ok */)
+		{ return static_cast<To&>(arg); }
+		template <typename To>
+		inline To& downcast_payload(basic_die& arg, std::false_type /* virtual base */);
+		template <typename To>
+		inline To& downcast_payload(basic_die& arg)
+		{ return downcast_payload<To>(arg, can_static_downcast<To>()); }
 		// We want to partially specialize a function template, 
 		// which we can't do. So pull out the core into a class
 		// template which we call from the (non-specialised) function template.
@@ -253,7 +297,7 @@ namespace dwarf
 			typedef basic_die& base_ref;
 			typedef std::function<derived_ref(base_ref)> transformer;
 			inline static derived_ref transf(base_ref arg) { 
-				return dynamic_cast<Payload&>(arg);
+				return downcast_payload<Payload>(arg);
 			}
 
 			// HMM: same as above.
@@ -282,13 +326,74 @@ namespace dwarf
 			operator()(pair<Iter, Iter>&& in_seq);
 		};
 		
+		/* Size-class slab allocation for payloads. Each root_die owns one,
+		 * and the factories allocate payloads from it (see basic_die's 
+		 * operator new). Freed blocks go back on a per-class free list; the
+		 * slabs themselves are only released, all at once, when the 
+		 * allocator (i.e. the root) is destroyed. So payloads mustn't 
+		 * outlive their root -- but that was already true, since they hold
+		 * libdwarf handles. 
+		 * 
+		 * The counters are cumulative, so diff them around a query to see 
+		 * how many payloads it made. */
+		struct payload_allocator
+		{
+			struct counters
+			{
+				unsigned long allocated; // payloads ever allocated
+				unsigned long freed;     // ... and since freed
+				size_t slab_bytes;       // memory held in slabs
+			};
+			
+			payload_allocator() : free_lists(), slabs(), cur_counters(), shared(false) {}
+			~payload_allocator();
+			
+			/* Once shared, allocation and deallocation take a lock, since 
+			 * payloads may then be made and freed by several threads (see
+			 * root_die::enable_concurrent_readers()). */
+			void set_shared(bool s) { shared = s; }
+			
+			void *allocate(size_t sz);
+			/* For payloads made outside any root; these use the global heap. */
+			static void *allocate_unowned(size_t sz);
+			/* These work for any block from basic_die's operator new. */
+			static void deallocate(void *obj);
+			static size_t allocation_size(void *obj);
+			
+			const counters& get_counters() const { return cur_counters; }
+			
+		private:
+			payload_allocator(const payload_allocator&) = delete;
+			payload_allocator& operator=(const payload_allocator&) = delete;
+			
+			/* Every block starts with this, so that we can find our way 
+			 * back from the object. The object follows, suitably aligned. */
+			struct block_header
+			{
+				payload_allocator *owner; // null if from the global heap
+				unsigned size_class;
+			};
+			static const size_t HEADER_SIZE = 16;
+			static const size_t GRANULE = 16;
+			static const unsigned NCLASSES = 64; // so up to 1KB of object
+			static const size_t SLAB_SIZE = 64 * 1024;
+			static const unsigned BIG = (unsigned) -1; // global heap, not a slab
+			
+			void *free_lists[NCLASSES];
+			vector<void *> slabs;
+			counters cur_counters;
+			bool shared;
+			std::mutex lock;
+		};
+		
 		class basic_die : public virtual abstract_die
 		{
 			friend struct iterator_base;
 			friend class root_die;
+			friend struct attribute_view; // see native.hpp
 		protected:
-			// we need to embed a refcount
-			unsigned refcount;
+			// we need to embed a refcount -- atomic, since concurrent readers share sticky payloads
+			std::atomic<unsigned> refcount;
 			
 			// we need this, if we're libdwarf-backed; if not, it's null
 			Die d;
@@ -359,6 +464,22 @@ namespace dwarf
 			
 			virtual ~basic_die() {}
 			
+			/* Payloads come from their root's payload_allocator (the 
+			 * factories use the placement form). Plain "new" still works,
+			 * going to the global heap, so that delete can handle both. */
+			static void *operator new(size_t sz) { return payload_allocator::allocate_unowned(sz); }
+			static void *operator new(size_t sz, payload_allocator& a) { return a.allocate(sz); }
+			static void operator delete(void *obj) { payload_allocator::deallocate(obj); }
+			static void operator delete(void *obj, payload_allocator& a) { payload_allocator::deallocate(obj); }
+			
+			/* Sticky payloads are shared by concurrent readers (see 
+			 * root_die::enable_concurrent_readers()), and their handles are on
+			 * the root's Debug. So anything that passes d to libdwarf, or fills
+			 * a lazily built cache, holds this; otherwise it does nothing. 
+			 * (dwarf_dieoffset, dwarf_tag, dwarf_hasattr and 
+			 * dwarf_CU_dieoffset_given_die only read the DIE, so don't need it.) */
+			std::unique_lock<std::recursive_mutex> shared_guard() const;
+			
 			/* implement the abstract_die interface 
 			 * -- note that has_attr is defined above */
 			inline Dwarf_Off get_offset() const { assert(d.handle); return d.offset_here(); }
@@ -366,11 +487,13 @@ namespace dwarf
 			inline opt<string> get_name() const 
 			{ 
 				assert(d.handle); 
-				if (d.name_here()) return opt<string>(string(d.name_here().get()));
+				auto guard = shared_guard();
+				auto name = d.name_here();
+				if (name) return opt<string>(string(name.get()));
 				else return opt<string>();
 			}
 			inline unique_ptr<const char, string_deleter> get_raw_name() const
-			{ assert(d.handle); return d.name_here(); }
+			{ assert(d.handle); auto guard = shared_guard(); return d.name_here(); }
 			inline Dwarf_Off get_enclosing_cu_offset() const 
 			{ assert(d.handle); return d.enclosing_cu_offset_here(); }
 			/* The same as all_attrs, but comes from abstract_die. 
@@ -379,6 +502,7 @@ namespace dwarf
 			inline encap::attribute_map copy_attrs(opt<root_die&> opt_r) const
 			{
 				//return all_attrs(opt_r); 
+				auto guard = shared_guard();
 				return encap::attribute_map(AttributeList(d), d, get_root(opt_r));
 			}
 			inline spec& get_spec(root_die& r) const 
@@ -402,18 +526,345 @@ namespace dwarf
 		std::ostream& operator<<(std::ostream& s, const basic_die& d);
 		inline void intrusive_ptr_add_ref(basic_die *p)
 		{
-			++(p->refcount);
+			p->refcount.fetch_add(1, std::memory_order_relaxed);
 		}
 		inline void intrusive_ptr_release(basic_die *p)
 		{
-			--(p->refcount);
-			if (p->refcount == 0) delete p;
+			// whoever takes the count to zero is the only one left
+			if (p->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete p;
 		}
 		
 		//template <typename Pred, typename DerefAs = basic_die> 
 		//using iterator_sibs_where
 		// = boost::filter_iterator< Pred, iterator_sibs<DerefAs> >;
 		
+		/* Dense per-CU topology. Within a CU, DIEs are laid out in depth-first
+		 * order, so their offsets are strictly increasing in that order. We 
+		 * number them 0..n-1 ("ordinals"; the CU DIE is ordinal 0) and keep the
+		 * tree edges in flat arrays indexed by ordinal. Getting from an offset
+		 * to an ordinal is a binary search on the offsets array. This is a lot
+		 * denser (and friendlier to the cache) than one node-based map per 
+		 * edge kind, which is what we used to have. 
+		 * 
+		 * We only ever describe libdwarf-backed DIEs this way. In-memory DIEs
+		 * (see make_new()) are still described by the maps in root_die. */
+		struct cu_topology
+		{
+			typedef unsigned ordinal_t;
+			static const ordinal_t NONE = (ordinal_t) -1;
+			
+			Dwarf_Off cu_offset;  // offset of the CU DIE, i.e. of ordinal 0
+			Dwarf_Off end_offset; // first offset past the end of this CU
+			vector<Dwarf_Off> offsets;
+			vector<ordinal_t> parent;
+			vector<ordinal_t> first_child;
+			vector<ordinal_t> next_sibling;
+			vector<unsigned short> depth; // as seen by iterators, i.e. CU is 1
+			vector<Dwarf_Half> tag;
+			/* Each DIE's children's offsets, as one run per DIE: o's are 
+			 * child_offsets[child_begin[o]] up to child_offsets[child_begin[o + 1]].
+			 * Filled in from the above by index_children(). */
+			vector<unsigned> child_begin;
+			vector<Dwarf_Off> child_offsets;
+			
+			cu_topology() : cu_offset(0UL), end_offset(0UL) {}
+			
+			unsigned size() const { return offsets.size(); }
+			bool contains(Dwarf_Off off) const 
+			{ return off >= cu_offset && off < end_offset; }
+			ordinal_t ordinal_of(Dwarf_Off off) const
+			{
+				auto found = std::lower_bound(offsets.begin(), offsets.end(), off);
+				if (found == offsets.end() || *found != off) return NONE;
+				return found - offsets.begin();
+			}
+			unsigned depth_of(ordinal_t o) const { return depth[o]; }
+			Dwarf_Half tag_of(ordinal_t o) const { return tag[o]; }
+			unsigned child_count(ordinal_t o) const 
+			{ return child_begin[o + 1] - child_begin[o]; }
+			pair<const Dwarf_Off *, const Dwarf_Off *> children_of(ordinal_t o) const
+			{
+				const Dwarf_Off *base = child_offsets.data();
+				return make_pair(base + child_begin[o], base + child_begin[o + 1]);
+			}
+			
+			/* Walk the CU at cu_off using raw libdwarf calls, filling in 
+			 * all of the above. We take a raw Dwarf_Debug so that we don't 
+			 * touch any root_die state. */
+			void build(Dwarf_Debug dbg, Dwarf_Off cu_off);
+			/* Fill in child_begin and child_offsets, e.g. after loading the
+			 * rest from an index. */
+			void index_children();
+		private:
+			ordinal_t append(Dwarf_Off off, Dwarf_Half t, ordinal_t parent_ord)
+			{
+				assert(offsets.size() == 0 || off > offsets.back());
+				offsets.push_back(off);
+				parent.push_back(parent_ord);
+				first_child.push_back(NONE);
+				next_sibling.push_back(NONE);
+				depth.push_back(parent_ord == NONE ? 1 : depth[parent_ord] + 1);
+				tag.push_back(t);
+				return offsets.size() - 1;
+			}
+		};
+		
+		/* One entry in the table mapping addresses to CUs. The layout of this 
+		 * is shared with the on-disk index (see index.cpp), so keep it POD. */
+		struct cu_address_range
+		{
+			Dwarf_Addr begin; // file-relative, inclusive
+			Dwarf_Addr end;   // file-relative, exclusive
+			Dwarf_Off cu_offset;
+			bool operator<(const cu_address_range& arg) const 
+			{ return begin < arg.begin; }
+		};
+		
+		/* The address-to-scope index (see root_die::scopes_at()) is a table
+		 * of scopes, each knowing its enclosing scope, plus a sorted list of 
+		 * disjoint address segments, each mapped to the innermost scope 
+		 * covering it. */
+		struct address_scope
+		{
+			Dwarf_Off offset;
+			unsigned short depth;
+			unsigned parent; // index into the scope table, or NO_PARENT
+			static const unsigned NO_PARENT = (unsigned) -1;
+		};
+		struct scope_segment
+		{
+			Dwarf_Addr begin; // file-relative, inclusive
+			Dwarf_Addr end;   // file-relative, exclusive
+			unsigned scope;   // index into the scope table
+			bool operator<(const scope_segment& arg) const 
+			{ return begin < arg.begin; }
+		};
+		
+		/* One reference in the reverse-reference index (see 
+		 * root_die::referrers_of()). We keep these in one vector sorted by 
+		 * target, so all the referrers of a DIE are contiguous. */
+		struct reference_edge
+		{
+			Dwarf_Off target;
+			Dwarf_Off referrer;
+			Dwarf_Half attr;
+			bool operator<(const reference_edge& arg) const 
+			{ 
+				return target < arg.target 
+					|| (target == arg.target && (referrer < arg.referrer
+						|| (referrer == arg.referrer && attr < arg.attr)));
+			}
+		};
+		
+		/* What dwarf_next_cu_header_b tells us about a CU. We read every 
+		 * header once, into a table sorted by CU DIE offset, so that we 
+		 * never need libdwarf's stateful CU cursor after that. Since CUs
+		 * don't overlap, the same table maps any offset to its CU by
+		 * binary search (see root_die::cu_header_containing()). */
+		struct native_reader; // see native.hpp
+		struct visited_die;   // likewise
+		class basic_die;
+		
+		struct cu_header_info
+		{
+			Dwarf_Off cu_offset; // of the CU DIE, not the header
+			Dwarf_Unsigned cu_header_length;
+			Dwarf_Half version_stamp;
+			Dwarf_Unsigned abbrev_offset;
+			Dwarf_Half address_size;
+			Dwarf_Half offset_size;
+			Dwarf_Half extension_size;
+			Dwarf_Unsigned next_cu_header;
+			Dwarf_Off cu_end; // one past the CU's last byte
+			/* The CU's payload, once somebody has made it. CU payloads are
+			 * sticky, so this stays good for as long as the root_die does.
+			 * Readers may race to fill it in, but they all write the same
+			 * (published) payload. */
+			struct payload_slot : std::atomic<basic_die *>
+			{
+				payload_slot() : std::atomic<basic_die *>(nullptr) {}
+				payload_slot(const payload_slot& arg) : std::atomic<basic_die *>(arg.load()) {}
+				payload_slot& operator=(const payload_slot& arg) { store(arg.load()); return *this; }
+			};
+			mutable payload_slot p_payload;
+			bool operator<(const cu_header_info& arg) const { return cu_offset < arg.cu_offset; }
+		};
+		
+		/* What root_die::scan() gives back: one row per DIE, in depth-first 
+		 * order, kept as one plain vector per column. Only the columns that 
+		 * were asked for are filled in; the others stay empty. Names are ids
+		 * into a table of views, which point into the mapped string sections
+		 * (see root_die::name_view()) and are good for as long as the 
+		 * root_die is. */
+		struct scan_table
+		{
+			enum column
+			{
+				OFFSET = 1,
+				PARENT = 2,    // offset of the parent; 0 for CUs
+				TAG = 4,
+				DEPTH = 8,     // as for iterators, i.e. CUs are 1
+				NAME = 16,
+				TYPE = 32,     // what DW_AT_type refers to; 0 if nothing
+				BYTE_SIZE = 64 // constant DW_AT_byte_size, if any
+			};
+			static const uint32_t NO_NAME = (uint32_t) -1;
+			static const Dwarf_Unsigned NO_BYTE_SIZE = (Dwarf_Unsigned) -1;
+			
+			unsigned columns;
+			unsigned long rows;
+			vector<Dwarf_Off> offset;
+			vector<Dwarf_Off> parent;
+			vector<Dwarf_Half> tag;
+			vector<unsigned short> depth;
+			vector<uint32_t> name;
+			vector<Dwarf_Off> type;
+			vector<Dwarf_Unsigned> byte_size;
+			vector<string_view> names;
+			
+			explicit scan_table(unsigned columns = 0) : columns(columns), rows(0) {}
+			unsigned long size() const { return rows; }
+			/* Add arg's rows after ours, merging its names into ours. */
+			void append(const scan_table& arg);
+		};
+		
+		/* A hash map split into independently locked shards, so that 
+		 * threads working on different keys rarely contend. Values are 
+		 * copied out, so nobody holds a reference into a shard once its 
+		 * lock is dropped. insert() is publish-once: if the key is already 
+		 * there, the existing value wins and is what we return. */
+		template <typename Key, typename Value, typename Hash = std::hash<Key> >
+		struct sharded_map
+		{
+			bool find(const Key& k, Value& out) const
+			{
+				const shard& s = shard_for(k);
+				std::lock_guard<std::mutex> guard(s.lock);
+				auto found = s.m.find(k);
+				if (found == s.m.end()) return false;
+				out = found->second;
+				return true;
+			}
+			pair<Value, bool> insert(const Key& k, const Value& v)
+			{
+				shard& s = shard_for(k);
+				std::lock_guard<std::mutex> guard(s.lock);
+				auto inserted = s.m.insert(make_pair(k, v));
+				return make_pair(inserted.first->second, inserted.second);
+			}
+			void set(const Key& k, const Value& v)
+			{
+				shard& s = shard_for(k);
+				std::lock_guard<std::mutex> guard(s.lock);
+				s.m[k] = v;
+			}
+			void clear()
+			{
+				for (unsigned i = 0; i < NSHARDS; ++i)
+				{
+					std::lock_guard<std::mutex> guard(shards[i].lock);
+					shards[i].m.clear();
+				}
+			}
+			/* Visits one shard at a time, so this isn't a snapshot if 
+			 * others are writing. */
+			template <typename Fn>
+			void for_each(Fn fn) const
+			{
+				for (unsigned i = 0; i < NSHARDS; ++i)
+				{
+					std::lock_guard<std::mutex> guard(shards[i].lock);
+					for (auto i_e = shards[i].m.begin(); i_e != shards[i].m.end(); ++i_e)
+					{
+						fn(i_e->first, i_e->second);
+					}
+				}
+			}
+		private:
+			static const unsigned SHARD_BITS = 6;
+			static const unsigned NSHARDS = 1u << SHARD_BITS;
+			struct shard
+			{
+				mutable std::mutex lock;
+				unordered_map<Key, Value, Hash> m;
+			};
+			shard shards[NSHARDS];
+			/* DIE offsets' low bits are not very random, so mix first. */
+			static unsigned shard_index(const Key& k)
+			{ return (uint64_t(Hash()(k)) * 0x9e3779b97f4a7c15ull) >> (64 - SHARD_BITS); }
+			shard& shard_for(const Key& k) { return shards[shard_index(k)]; }
+			const shard& shard_for(const Key& k) const { return shards[shard_index(k)]; }
+		};
+		struct offset_pair_hash
+		{
+			template <typename T>
+			size_t operator()(const pair<Dwarf_Off, T>& p) const
+			{ return std::hash<Dwarf_Off>()(p.first) * 31 + std::hash<Dwarf_Off>()(p.second); }
+		};
+		
+		/* A memory-bounded cache of non-sticky payloads (see 
+		 * root_die::set_payload_cache()). Between "not sticky" (payload dies
+		 * with its last iterator) and "sticky" (payload lives as long as the 
+		 * root), this keeps recently used payloads alive -- along with 
+		 * anything they've cached, like a type's summary code -- until the
+		 * budget runs out. Eviction only drops the cache's reference, so 
+		 * payloads that iterators still hold are unaffected. 
+		 *
+		 * The eviction policy is up to the subclass. */
+		struct payload_cache
+		{
+			typedef intrusive_ptr<basic_die> ptr_type;
+			
+			explicit payload_cache(size_t budget) : budget(budget), used(0) {}
+			virtual ~payload_cache() {}
+			
+			/* Null if not present; a hit counts as a use. */
+			virtual ptr_type get(Dwarf_Off off) = 0;
+			/* Insert, evicting as necessary to stay within budget. "cost" is
+			 * in bytes. Things costing more than the whole budget aren't kept. */
+			virtual void put(Dwarf_Off off, const ptr_type& p, size_t cost) = 0;
+			virtual void erase(Dwarf_Off off) = 0;
+			virtual void clear() = 0;
+			
+			size_t get_budget() const { return budget; }
+			size_t get_used() const { return used; }
+		protected:
+			size_t budget;
+			size_t used;
+		};
+		
+		/* Least-recently-used eviction. Exact, but every hit relinks a list node. */
+		struct lru_payload_cache : public payload_cache
+		{
+			explicit lru_payload_cache(size_t budget) : payload_cache(budget) {}
+			ptr_type get(Dwarf_Off off);
+			void put(Dwarf_Off off, const ptr_type& p, size_t cost);
+			void erase(Dwarf_Off off);
+			void clear() { entries.clear(); by_offset.clear(); used = 0; }
+		private:
+			struct entry { Dwarf_Off off; ptr_type p; size_t cost; };
+			std::list<entry> entries; // most recently used first
+			unordered_map<Dwarf_Off, std::list<entry>::iterator> by_offset;
+		};
+		
+		/* CLOCK (second-chance) eviction. Approximates LRU; a hit just sets
+		 * a bit, so it's cheaper when hits dominate. */
+		struct clock_payload_cache : public payload_cache
+		{
+			explicit clock_payload_cache(size_t budget) : payload_cache(budget), hand(0) {}
+			ptr_type get(Dwarf_Off off);
+			void put(Dwarf_Off off, const ptr_type& p, size_t cost);
+			void erase(Dwarf_Off off);
+			void clear() { slots.clear(); free_slots.clear(); by_offset.clear(); hand = 0; used = 0; }
+		private:
+			struct slot { Dwarf_Off off; ptr_type p; size_t cost; bool referenced; };
+			vector<slot> slots; // empty slots have a null p
+			vector<unsigned> free_slots;
+			unordered_map<Dwarf_Off, unsigned> by_offset;
+			unsigned hand;
+			void evict(unsigned i);
+		};
+		
 		// FIXME: this is not libdwarf-agnostic! 
 		// ** Could we use it for encap too, with a null Debug?
 		// ** Can we abstract out a core base class
@@ -442,16 +893,94 @@ namespace dwarf
 			
 		protected: // was protected -- consider changing back
 			typedef intrusive_ptr<basic_die> ptr_type;
+			/* Payload memory must outlive all payloads, so this comes first. */
+			payload_allocator payload_alloc;
 			Debug dbg;
 			/* NOTE: sticky_dies must come after dbg, because all Dwarf_Dies are 
 			 * destructed when a Dwarf_Debug is destructed. So our intrusive_ptrs
 			 * will be invalid if we destruct the latter first, and bad results follow. */
 			map<Dwarf_Off, ptr_type > sticky_dies; // compile_unit_die is always sticky
+			/* Likewise for cached payloads. Null means no caching. */
+			unique_ptr<payload_cache> p_payload_cache;
+			/* In concurrent-reader mode, each thread that navigates gets its
+			 * own Dwarf_Debug. */
+			struct reader_state
+			{
+				Debug dbg;
+				explicit reader_state(int fd) : dbg(fd) {}
+			};
+			bool concurrent_readers;
+			map<std::thread::id, unique_ptr<reader_state> > readers;
+			std::mutex readers_lock;
+			unsigned long reader_generation; // tells our readers from those of a dead root_die
+			reader_state *this_reader();
+			/* A thread that's finished reading (e.g. a parallel_for_each_*() 
+			 * worker) can give back its Debug. Its iterators must be gone. */
+			void release_this_reader();
+			/* Sticky payloads, though, are shared between readers, so they
+			 * live here, seeded from sticky_dies. Each is published once: if
+			 * two readers race to make one, the loser's is thrown away. Their
+			 * handles are on dbg, which may only be used with 
+			 * shared_dbg_lock held (see basic_die::shared_guard()). */
+			sharded_map<Dwarf_Off, ptr_type> shared_sticky_dies;
+			std::recursive_mutex shared_dbg_lock;
+			ptr_type find_sticky(Dwarf_Off off)
+			{
+				if (!concurrent_readers)
+				{
+					auto found = sticky_dies.find(off);
+					return found == sticky_dies.end() ? ptr_type() : found->second;
+				}
+				ptr_type found;
+				shared_sticky_dies.find(off, found);
+				return found;
+			}
+			ptr_type make_shared_sticky(Dwarf_Off off);
+			/* We don't share the payload cache between threads: its payloads
+			 * are made on the readers' own Debugs. */
+			payload_cache *payload_cache_here() const
+			{ return concurrent_readers ? nullptr : p_payload_cache.get(); }
+			/* Topology of libdwarf-backed DIEs lives in per-CU dense stores, 
+			 * keyed by CU offset. We build these lazily, one CU at a time. */
+			map<Dwarf_Off, cu_topology> cu_topologies;
+			/* These maps now only record edges that the topologies can't: 
+			 * those touching in-memory DIEs (see make_new()). Root-to-CU and
+			 * CU-to-CU edges come from the CU header table. */
 			map<Dwarf_Off, Dwarf_Off> parent_of;
 			map<Dwarf_Off, Dwarf_Off> first_child_of;
 			map<Dwarf_Off, Dwarf_Off> next_sibling_of;
-			map<pair<Dwarf_Off, Dwarf_Half>, Dwarf_Off> refers_to;
-			map<Dwarf_Off, pair< Dwarf_Off, bool> > equal_to;
+			/* Child-to-parent edges between file DIEs that find_downwards()
+			 * has stepped over, in CUs whose topology we haven't built,
+			 * keyed by CU offset. find_upwards() and parent() use these
+			 * rather than build a topology, and find_downwards() resumes
+			 * from them. Installing a CU's topology drops its map. Only the
+			 * sequential code writes these: concurrent readers have every
+			 * topology (see enable_concurrent_readers()). */
+			map<Dwarf_Off, map<Dwarf_Off, Dwarf_Off> > descent_parents;
+			optional<Dwarf_Off> descent_parent_of(Dwarf_Off off) const;
+			vector<Dwarf_Off> descent_path_before(Dwarf_Off cu_off, Dwarf_Off off) const;
+			/* Child offsets for the DIEs whose children the topologies can't 
+			 * list by themselves: the root, in-memory DIEs and DIEs with 
+			 * in-memory children. Built on first use; make_new() drops the 
+			 * parent's entry. Concurrent readers only ever add entries. */
+			map<Dwarf_Off, vector<Dwarf_Off> > cached_child_offsets;
+			std::mutex cached_child_offsets_lock;
+			/* Children by name, for DIEs that can have named children 
+			 * (see named_children_of()). Keyed by offset rather than held
+			 * by the payload, so that structures' and enumerations' tables 
+			 * outlive their (non-sticky) payloads. Same rules as 
+			 * cached_child_offsets: built on first use, make_new() drops
+			 * the parent's entry, and concurrent readers only ever add. 
+			 * Null means the DIE has in-memory children, whose names may
+			 * change under us, so we don't index it. */
+			unordered_map<Dwarf_Off, unique_ptr<unordered_map<string, vector<Dwarf_Off> > > >
+				cached_named_children;
+			std::mutex cached_named_children_lock;
+			/* These two are written during queries, so they're sharded 
+			 * (and safe for concurrent readers). equal_to is keyed by 
+			 * (self, other). */
+			sharded_map<pair<Dwarf_Off, Dwarf_Half>, Dwarf_Off, offset_pair_hash> refers_to;
+			sharded_map<pair<Dwarf_Off, Dwarf_Off>, bool, offset_pair_hash> equal_to;
 
 			multimap<string, Dwarf_Off> visible_named_grandchildren;
 			bool visible_named_grandchildren_is_complete;
@@ -459,6 +988,67 @@ namespace dwarf
 			FrameSection *p_fs;
 			Dwarf_Off current_cu_offset; // 0 means none
 			::Elf *returned_elf;
+			int fd; // -1 if we weren't opened from a file; build_index() needs it
+			/* The index file we mapped, if any (see load_index()). */
+			void *mapped_index;
+			size_t mapped_index_len;
+			/* CU address ranges, sorted by start address. These point either
+			 * into the mapped index or into cu_ranges_storage. */
+			bool have_cu_ranges;
+			vector<cu_address_range> cu_ranges_storage;
+			const cu_address_range *cu_ranges_begin;
+			const cu_address_range *cu_ranges_end;
+			void ensure_cu_address_ranges();
+			/* Name-lookup accelerator tables (see accel.cpp). */
+			enum { ACCEL_UNKNOWN, ACCEL_NONE, ACCEL_PUBNAMES, ACCEL_GDB_INDEX } accel_kind;
+			unordered_multimap<string, Dwarf_Off> pubnames_dies; // pubnames + pubtypes
+			const unsigned char *gdb_index_data;
+			size_t gdb_index_len;
+			void init_accelerator();
+			/* The address-to-scope index (see scopes_at()). */
+			bool have_scope_index;
+			vector<address_scope> scope_table;
+			vector<scope_segment> scope_segments;
+			void ensure_scope_index();
+			/* The reverse-reference index (see referrers_of()). The file's
+			 * edges are decoded once; in-memory DIEs' edges are redone 
+			 * whenever have_reverse_refs is cleared (e.g. by make_new()). */
+			bool have_reverse_refs;
+			bool have_file_reverse_refs;
+			vector<reference_edge> reverse_refs;
+			void build_file_reverse_references(unsigned nthreads);
+			/* Every CU header in the file, by CU DIE offset. Once built, 
+			 * this is never modified. */
+			bool have_cu_headers;
+			vector<cu_header_info> cu_headers;
+			void ensure_cu_headers();
+			/* The native DIE reader (see native.hpp), made on first use. */
+			bool tried_native_reader;
+			native_reader *p_native_reader;
+			/* Names for name_view() when they can't come straight from the
+			 * mapped sections: by offset for DIEs in the file, and interned
+			 * for in-memory DIEs (whose names may change). Neither is ever
+			 * erased from, so the views stay good. */
+			unordered_map<Dwarf_Off, opt<string> > copied_names;
+			unordered_set<string> in_memory_names;
+			std::mutex copied_names_lock;
+		public:
+			/* Null if off isn't the offset of a libdwarf-backed CU DIE. */
+			const cu_header_info *cu_header_for(Dwarf_Off off);
+			/* Null if off isn't inside a libdwarf-backed CU. Offsets of 
+			 * in-memory DIEs may fall inside one anyway, so only ask about 
+			 * libdwarf-backed DIEs. */
+			const cu_header_info *cu_header_containing(Dwarf_Off off);
+			/* Like d.get_enclosing_cu_offset(), but without asking libdwarf
+			 * if d is libdwarf-backed. */
+			Dwarf_Off enclosing_cu_offset_of(const basic_die& d);
+			/* Null if the native reader can't read this file (e.g. because 
+			 * it's relocatable, or in-memory), in which case use iterators. */
+			native_reader *get_native_reader();
+		protected:
+			/* The Dwarf_Debug that the calling thread should use to make new
+			 * handles. This is just dbg unless we have concurrent readers. */
+			Dwarf_Debug dbg_for_this_thread();
 		public:
 			FrameSection&       get_frame_section()       { assert(p_fs); return *p_fs; }
 			const FrameSection& get_frame_section() const { assert(p_fs); return *p_fs; }
@@ -472,12 +1062,201 @@ namespace dwarf
 				map<Dwarf_Off, Dwarf_Off>& parent_of,
 				map<pair<Dwarf_Off, Dwarf_Half>, Dwarf_Off>& refers_to) const;
 
+			/* Topology helpers. topology_containing() only looks at what
+			 * we've already built; topology_for_cu() will build if need be. 
+			 * Both return null if there's no libdwarf-backed CU to describe. */
+			const cu_topology *topology_containing(Dwarf_Off off) const;
+			const cu_topology *topology_for_cu(Dwarf_Off cu_off);
+			/* Get the ordinal of a libdwarf-backed DIE. If we had to build a
+			 * topology, we use the iterator's handle to find the CU. */
+			pair<const cu_topology *, cu_topology::ordinal_t> 
+			topology_position(const iterator_base& it);
+		public:
+			/* Build the topology of every CU up front, using nthreads worker
+			 * threads (0 means one per hardware thread). Each worker opens 
+			 * its own Dwarf_Debug on our file, so that libdwarf's per-Debug
+			 * state (e.g. the CU context) is never shared between threads. */
+			void build_index(unsigned nthreads = 0);
+			
+			/* Persistent index. We can write the topology, the named grandchildren
+			 * and the CUs' address ranges to a file, then later map it back in 
+			 * instead of rediscovering all that. Index files are keyed by the ELF
+			 * file's build ID (NT_GNU_BUILD_ID); we won't write an index for a 
+			 * file without one, and we won't load an index whose build ID doesn't 
+			 * match ours. Load the index before calling make_new(). */
+			vector<unsigned char> build_id();
+			bool write_index(const string& path, unsigned nthreads = 0);
+			bool load_index(const string& path);
+			/* Load <dir>/<build-id>.dwarfpp-index if it's there and good; 
+			 * otherwise build the index and try to save it there. */
+			bool use_index_cache(const string& dir, unsigned nthreads = 0);
+			/* Which CU covers this file-relative address? */
+			iterator_df<compile_unit_die> cu_for_addr(Dwarf_Addr file_relative_addr);
+			/* All the scopes -- CU, subprograms, lexical blocks and inlined 
+			 * subroutines -- whose ranges contain a file-relative address, 
+			 * innermost first. The first call builds an index over the whole
+			 * file (using build_index()); after that, this is a binary search 
+			 * plus a walk up the chain. */
+			vector<iterator_base> scopes_at(Dwarf_Addr file_relative_addr);
+			/* Every (referrer, attribute) pair whose attribute refers to the
+			 * DIE at "off", e.g. all the DW_AT_types naming a given type. The 
+			 * first call (or build_reverse_references()) decodes the 
+			 * reference attributes of every DIE in one pass, in parallel,
+			 * plus those of any in-memory DIEs. DW_AT_sibling doesn't count
+			 * here (though the index keeps it, for get_referential_structure()).
+			 * make_new() invalidates the in-memory part; if you change an 
+			 * in-memory DIE's reference attributes, call 
+			 * invalidate_reverse_references() yourself. */
+			vector<pair<Dwarf_Off, Dwarf_Half> > referrers_of(Dwarf_Off off);
+			void build_reverse_references(unsigned nthreads = 0);
+			void invalidate_reverse_references() { have_reverse_refs = false; }
+			
+			/* Concurrent-reader mode. After this, any number of threads may
+			 * navigate and query this root at once, each through its own
+			 * iterators (iterators, and non-sticky payloads reached through 
+			 * them, belong to the thread that made them). Each thread gets 
+			 * its own Dwarf_Debug, so libdwarf's per-Debug state is never 
+			 * shared. Sticky payloads, refers_to and equal_to are shared and
+			 * filled concurrently; everything else is built here, up front, 
+			 * then only read. So call this before starting the readers, and
+			 * don't make_new() until disable_concurrent_readers(). 
+			 * scopes_at() and referrers_of() build their indexes lazily, so
+			 * use them once first if readers will. The payload cache is 
+			 * bypassed. Returns false if we can't do it, i.e. we weren't 
+			 * opened from a file or were built without thread-local error
+			 * state. */
+			bool enable_concurrent_readers(unsigned nthreads = 0);
+			/* Back to sequential use. Only call this once every reader has
+			 * stopped and all their iterators (and non-sticky payloads) are
+			 * gone: we drop the readers' Debugs. Sticky payloads the readers
+			 * made are kept. Does nothing if we're not in the mode. */
+			void disable_concurrent_readers();
+			bool has_concurrent_readers() const { return concurrent_readers; }
+			/* The lock to hold while using a handle on dbg, if any. */
+			std::recursive_mutex *shared_lock_for(Dwarf_Debug d)
+			{ return (concurrent_readers && d == dbg.raw_handle()) ? &shared_dbg_lock : nullptr; }
+			
+			/* Parallel traversal. These enter concurrent-reader mode (if we 
+			 * can't, everything runs on the calling thread; if we had to 
+			 * enter it, we leave it again before returning), split the tree 
+			 * into units of work and run them on nthreads workers (0 means 
+			 * one per hardware thread; the calling thread is one of them). 
+			 * Each worker takes units from its own queue and steals from the 
+			 * back of others' when that runs dry. parallel_for_each_cu() 
+			 * makes one unit per CU; parallel_for_each_die() also splits big 
+			 * CUs into runs of child subtrees. fn runs on whichever worker 
+			 * got the unit, so it must not keep the iterators it is given 
+			 * (nor, below, return them or their payloads). 
+			 * The first exception thrown is rethrown once all workers stop. */
+			void parallel_for_each_cu(
+				std::function<void(const iterator_df<compile_unit_die>&)> fn,
+				unsigned nthreads = 0);
+			void parallel_for_each_die(
+				std::function<bool(const iterator_base&)> pred,
+				std::function<void(const iterator_base&)> fn,
+				unsigned nthreads = 0);
+			/* Deterministic versions: each unit collects into its own vector,
+			 * and we concatenate these in unit order, so results come out in 
+			 * depth-first order however the work was scheduled. */
+			template <typename T>
+			vector<T> parallel_collect_from_cus(
+				std::function<void(const iterator_df<compile_unit_die>&, vector<T>&)> fn,
+				unsigned nthreads = 0);
+			template <typename T>
+			vector<T> parallel_collect_dies(
+				std::function<bool(const iterator_base&)> pred,
+				std::function<T(const iterator_base&)> fn,
+				unsigned nthreads = 0);
+			
+			/* Columnar export: one pass over each CU (on several threads, 
+			 * where we can), collecting just the given columns (an OR of 
+			 * scan_table::column) for each DIE that pred accepts. pred sees
+			 * only the offset, tag and depth, so deciding costs nothing; a 
+			 * null pred takes everything. It must be safe to call from any
+			 * thread. If the native reader can see the whole file, we don't
+			 * make any iterators or payloads, and (except for anything it 
+			 * can't decode) don't call libdwarf; otherwise we walk each CU 
+			 * with iterators, using attribute views. nthreads is as for 
+			 * parallel_for_each_cu(). */
+			scan_table scan(unsigned columns,
+				std::function<bool(Dwarf_Off, Dwarf_Half, unsigned)> pred = nullptr,
+				unsigned nthreads = 0);
+			
+			/* Depth-first visiting, for code that looks at every DIE's tag
+			 * and decides whether to go further. pre sees each DIE in 
+			 * depth-first order (as a visited_die, in native.hpp: offset, 
+			 * tag, depth and a way to get at the attributes) and says 
+			 * whether to carry on into its children, skip them or stop 
+			 * altogether. post, if given, sees each DIE after its children
+			 * (or after pre, if they were skipped), except when we stop. 
+			 * If the native reader can see the whole file, we make no 
+			 * iterators or payloads at all; otherwise we walk handle-only 
+			 * iterators, moving rather than copying them. Either way, 
+			 * nothing goes in the parent or sibling caches. Returns false 
+			 * if pre stopped us. */
+			enum visit_action { CONTINUE, SKIP_SUBTREE, STOP };
+			bool visit(std::function<visit_action(const visited_die&)> pre,
+				std::function<void(const visited_die&)> post = nullptr);
+		protected:
+			/* The native reader, if it can see everything: no DIEs are in 
+			 * memory, and it has the same units as libdwarf. */
+			native_reader *native_reader_for_whole_file();
+			/* A unit of parallel work: ordinals [begin, end) of a CU's 
+			 * topology, which is always a run of whole subtrees (or a DIE 
+			 * followed by a run of its children's subtrees). If the CU has 
+			 * no topology (it's in memory), end is NONE: the whole CU. */
+			struct traversal_unit
+			{
+				Dwarf_Off cu_offset;
+				cu_topology::ordinal_t begin;
+				cu_topology::ordinal_t end;
+			};
+			/* If prepare_parallel() had to enter concurrent-reader mode, 
+			 * we leave it again when this goes away, so that sequential 
+			 * callers find things as they left them. If the caller had 
+			 * enabled the mode itself, we leave it alone. */
+			struct concurrent_section
+			{
+				root_die *p_entered;
+				concurrent_section() : p_entered(nullptr) {}
+				~concurrent_section() { if (p_entered) p_entered->disable_concurrent_readers(); }
+			};
+			/* Sets nthreads to the number of workers we'll really use. */
+			vector<traversal_unit> prepare_parallel(bool split_cus, unsigned& nthreads,
+				concurrent_section& section);
+			/* Calls fn(unit, worker) for each unit in [0, nunits), on up to
+			 * nthreads threads, the calling thread being worker 0. Workers
+			 * are numbered densely, so callers can give each one its own
+			 * state (e.g. a Debug). The first exception any worker throws 
+			 * stops the others taking more units and is rethrown here. */
+			void run_work_stealing(unsigned nunits, std::function<void(unsigned, unsigned)> fn, 
+				unsigned nthreads);
+			void walk_unit(const traversal_unit& u, 
+				const std::function<bool(const iterator_base&)>& pred,
+				const std::function<void(const iterator_base&)>& fn);
+		public:
+			
+			/* Keep non-sticky payloads alive in a bounded cache, e.g.
+			 *     r.set_payload_cache(unique_ptr<payload_cache>(new lru_payload_cache(64<<20)));
+			 * Passing null turns caching off (and drops what was cached). */
+			void set_payload_cache(unique_ptr<payload_cache> p_cache);
+			payload_cache *get_payload_cache() const { return p_payload_cache.get(); }
+			payload_allocator& get_payload_allocator() { return payload_alloc; }
+			const payload_allocator::counters& payload_counters() const
+			{ return payload_alloc.get_counters(); }
+		protected:
 		public: // HMM
 			virtual Dwarf_Off fresh_cu_offset();
 			virtual Dwarf_Off fresh_offset_under(const iterator_base& pos);
 		
 		protected:
-			root_die() : dbg(), visible_named_grandchildren_is_complete(false), p_fs(nullptr) {}
+			root_die() : dbg(), concurrent_readers(false), reader_generation(0),
+			    visible_named_grandchildren_is_complete(false), p_fs(nullptr), fd(-1),
+			    mapped_index(nullptr), mapped_index_len(0), have_cu_ranges(false), 
+			    cu_ranges_begin(nullptr), cu_ranges_end(nullptr), accel_kind(ACCEL_UNKNOWN),
+			    gdb_index_data(nullptr), gdb_index_len(0), have_scope_index(false),
+			    have_reverse_refs(false), have_file_reverse_refs(false), have_cu_headers(false),
+			    tried_native_reader(false), p_native_reader(nullptr) {}
 		public:
 			root_die(int fd);
 			virtual ~root_die(); 
@@ -510,7 +1289,7 @@ namespace dwarf
 			>
 			children() const;
 			
-			typedef srk31::concatenating_iterator< iterator_sibs<basic_die>, basic_die, basic_die& > grandchildren_iterator;
+			typedef iterator_grandchildren grandchildren_iterator;
 			inline pair< grandchildren_iterator, grandchildren_iterator >
 			grandchildren() const;
 			
@@ -564,6 +1343,15 @@ namespace dwarf
 			iterator_base parent(const iterator_base& it);
 			iterator_base first_child(const iterator_base& it);
 			iterator_base next_sibling(const iterator_base& it);
+			/* Children by number, and backwards. The offsets are good until
+			 * the tree is next changed (by make_new()). */
+			pair<const Dwarf_Off *, const Dwarf_Off *> child_offsets(const iterator_base& it);
+			unsigned child_count(const iterator_base& it)
+			{ auto offs = child_offsets(it); return offs.second - offs.first; }
+			iterator_base nth_child(const iterator_base& it, unsigned n);
+			iterator_base last_child(const iterator_base& it);
+			iterator_base prev_sibling(const iterator_base& it);
+			bool move_to_prev_sibling(iterator_base& it);
 			/* 
 			 * NOTE: we *don't* put named_child and move_to_named_child here, because
 			 * we want to allow exploitation of in-payload data, which might support
@@ -575,12 +1363,35 @@ namespace dwarf
 			 * search (slow). This is the fallback implementation used by the iterator.
 			 */
 			iterator_base find_named_child(const iterator_base& start, const string& name);
+			/* The hash-table alternative: off's children by name. Each name
+			 * maps to the offsets of the children having it, in order, so 
+			 * the first is what find_named_child() would find. Built on 
+			 * first use, from *p_self if given (it must be at off), else by
+			 * finding off; it stays put thereafter. Null if off has 
+			 * in-memory children: use find_named_child() then. */
+			typedef unordered_map<string, vector<Dwarf_Off> > named_children_table;
+			const named_children_table *named_children_of(Dwarf_Off off,
+				const iterator_base *p_self = nullptr);
 			/* This one is only for searches anchored at the root, so no need for "start". */
 			iterator_base find_visible_named_grandchild(const string& name);
+			/* A DIE's name without copying it: the view points into the 
+			 * mapped .debug_str (or .debug_info, for inline strings) where 
+			 * the native reader can see it, else into a copy that we keep. 
+			 * Either way, it's good for as long as we are. */
+			opt<string_view> name_view(const iterator_base& pos);
+			/* Ask the accelerator tables (.gdb_index, or .debug_pubnames and
+			 * .debug_pubtypes) for offsets of CU-level DIEs that might be called
+			 * "name". Candidates still need checking. Returns true only if 
+			 * out is the complete answer (.gdb_index lists every CU that 
+			 * defines the name); otherwise (no table, or pubnames, which 
+			 * lists only external definitions) the caller must scan too. */
+			bool accelerated_grandchildren_named(const string& name, vector<Dwarf_Off>& out);
 			
 			bool is_under(const iterator_base& i1, const iterator_base& i2);
 			
-			// libdwarf has this weird stateful CU API
+			/* libdwarf has this weird stateful CU API. We no longer navigate
+			 * with it (see cu_headers), but it's here for anyone who does. 
+			 * Not for use with concurrent readers. */
 			optional<Dwarf_Off> first_cu_offset;
 			optional<Dwarf_Unsigned> last_seen_cu_header_length;
 			optional<Dwarf_Half> last_seen_version_stamp;
@@ -755,6 +1566,19 @@ namespace dwarf
 					default: assert(false);
 				}
 			}
+			/* The libdwarf handle behind this position, or null if it's 
+			 * in-memory (or not a DIE). Same as dynamic_cast<Die *>(&get_handle()),
+			 * but without the dynamic_cast. */
+			Die *libdwarf_handle() const
+			{
+				if (!is_real_die_position()) return nullptr;
+				switch (state)
+				{
+					case HANDLE_ONLY: return &cur_handle;
+					case WITH_PAYLOAD: return cur_payload->d.handle ? &cur_payload->d : nullptr;
+					default: assert(false); return nullptr;
+				}
+			}
 		private:
 			//Die::raw_handle_type raw_handle() const
 			//{
@@ -795,10 +1619,13 @@ namespace dwarf
 				assert(this->is_root_position());
 			}
 			
-			// this constructor sets us up using a payload ptr
-			//iterator_base(root_die::ptr_type p, unsigned depth, root_die& r)
-			// : cur_handle(Die(nullptr, nullptr)), cur_payload(p), state(WITH_PAYLOAD), 
-			//   m_depth(depth), p_root(&r) {}
+		private:
+			// this constructor sets us up using a payload ptr, for root_die 
+			// when it already has the (sticky) payload in hand
+			iterator_base(root_die::ptr_type p, unsigned depth, root_die& r)
+			 : cur_handle(Die(nullptr, nullptr)), cur_payload(std::move(p)), state(WITH_PAYLOAD), 
+			   m_depth(depth), p_root(&r) {}
+		public:
 			
 			// this constructor sets us up using a handle -- 
 			// this does the exploitation of the sticky set
@@ -808,27 +1635,39 @@ namespace dwarf
 				// get the offset of the handle we've been passed
 				Dwarf_Off off = d.get_offset(); 
 				// is it an existing sticky DIE?
-				auto found = r.sticky_dies.find(off);
-				if (found != r.sticky_dies.end())
+				auto found = r.find_sticky(off);
+				if (found)
 				{
 					// sticky and exists
 					cur_handle = Die(nullptr, nullptr);
 					state = WITH_PAYLOAD;
-					cur_payload = found->second;
-					assert(cur_payload);
+					cur_payload = std::move(found);
 					//m_depth = found->second->get_depth(); assert(depth == m_depth);
 					//p_root = &found->second->get_root();
 					
 					assert(r.is_sticky(d) || dynamic_cast<in_memory_abstract_die *>(&d));
 				}
+				else if (r.payload_cache_here() && (cur_payload = r.payload_cache_here()->get(off)))
+				{
+					// not sticky, but we kept its payload around
+					cur_handle = Die(nullptr, nullptr);
+					state = WITH_PAYLOAD;
+				}
 				else if (r.is_sticky(d))
 				{
 					// should be sticky, but does not exist yet -- use the factory
 					cur_handle = Die(nullptr, nullptr);
 					state = WITH_PAYLOAD;
-					cur_payload = factory::for_spec(d.get_spec(r)).make_payload(std::move(dynamic_cast<Die&&>(d).handle), r);
+					if (r.concurrent_readers) cur_payload = r.make_shared_sticky(off);
+					else
+					{
+						cur_payload = factory::for_spec(d.get_spec(r)).make_payload(std::move(dynamic_cast<Die&&>(d).handle), r);
+						r.sticky_dies[off] = cur_payload;
+					}
 					assert(cur_payload);
-					r.sticky_dies[off] = cur_payload;
+					// CUs' payloads also go in the CU table (see root_die::pos())
+					const cu_header_info *p_h = r.cu_header_for(off);
+					if (p_h) p_h->p_payload.store(cur_payload.get());
 				}
 				else
 				{
@@ -971,6 +1810,11 @@ namespace dwarf
 			
 			opt<string> 
 			name_here() const;
+			/* The same, as a view that lives as long as the root_die; 
+			 * see root_die::name_view(). Comparing names this way 
+			 * doesn't allocate. */
+			opt<string_view>
+			name_view_here() const;
 			
 			inline spec& spec_here() const;
 			
@@ -999,9 +1843,9 @@ namespace dwarf
 				if (state == HANDLE_ONLY)
 				{
 					return encap::attribute_map(
-						AttributeList(dynamic_cast<Die&>(get_handle())),
-						dynamic_cast<Die&>(get_handle()), 
-						opt_r ? *opt_r : dynamic_cast<Die&>(get_handle()).get_constructing_root()
+						AttributeList(cur_handle),
+						cur_handle, 
+						opt_r ? *opt_r : cur_handle.get_constructing_root()
 					);
 				} 
 				else 
@@ -1016,12 +1860,12 @@ namespace dwarf
 				
 				if (state == HANDLE_ONLY)
 				{
-					AttributeList l(dynamic_cast<Die&>(get_handle()));
+					AttributeList l(cur_handle);
 					for (auto i = l.copied_list.begin(); i != l.copied_list.end(); ++i)
 					{
 						if (i->attr_here() == attr)
 						{
-							return encap::attribute_value(*i, dynamic_cast<Die&>(get_handle()), get_root());
+							return encap::attribute_value(*i, cur_handle, get_root());
 						}
 					}
 					return encap::attribute_value();
@@ -1087,7 +1931,15 @@ namespace dwarf
 					
 			// some fast topological queries
 			Dwarf_Off enclosing_cu_offset_here() const
-			{ return get_handle().get_enclosing_cu_offset(); }
+			{
+				// libdwarf-backed DIEs can use the CU table
+				if (libdwarf_handle())
+				{
+					const cu_header_info *p_h = p_root->cu_header_containing(offset_here());
+					if (p_h) return p_h->cu_offset;
+				}
+				return get_handle().get_enclosing_cu_offset();
+			}
 			unsigned depth() const { return m_depth; }
 			unsigned get_depth() const { return m_depth; }
 			
@@ -1173,6 +2025,20 @@ namespace dwarf
 		template <typename Payload>
 		inline bool is_a_t<Payload>::operator()(const iterator_base& it) const
 		{
+			/* For classes the generator told us about, it's just a switch 
+			 * on the tag. FIXME: the relation is dwarf3's, but so is 
+			 * every factory right now (see factory::for_spec). */
+			if (payload_tags<Payload>::known)
+			{
+				bool ret = payload_tags<Payload>::contains(it.tag_here());
+#ifdef DWARFPP_CHECK_TAG_PREDS
+				/* Check the generated relation against the class hierarchy. */
+				assert(ret == (dynamic_cast<Payload *>(
+					factory::for_spec(it.spec_here()).dummy_for_tag(it.tag_here())
+				) != nullptr));
+#endif
+				return ret;
+			}
 			return dynamic_cast<Payload *>(
 				factory::for_spec(it.spec_here()).dummy_for_tag(it.tag_here())
 			) ? true : false;
@@ -1265,6 +2131,29 @@ namespace dwarf
 			const iterator_base& base() const
 			{ return static_cast<const iterator_base&>(*this); }
 			
+			/* Extra state: the offsets of our ancestors below the root, 
+			 * outermost first, as we came down through them. Climbing back 
+			 * up is then just pos(), where move_to_parent() would have to 
+			 * build the CU's topology. We only know them if we got here by
+			 * incrementing from a CU (or the root); otherwise, we ask the
+			 * root after all. */
+			vector<Dwarf_Off> m_ancestors;
+			bool ancestors_known() const
+			{ return depth() >= 1 && m_ancestors.size() + 1 == depth(); }
+			bool move_to_parent_here()
+			{
+				if (depth() > 1 && ancestors_known())
+				{
+					unsigned parent_depth = depth() - 1;
+					Dwarf_Off parent_off = m_ancestors.back();
+					m_ancestors.pop_back();
+					base_reference() = get_root().pos(parent_off, parent_depth);
+					return true;
+				}
+				m_ancestors.clear();
+				return get_root().move_to_parent(base_reference());
+			}
+			
 			iterator_df() : iterator_base() {}
 			iterator_df(const iterator_base& arg)
 			 : iterator_base(arg) {}// this COPIES so avoid
@@ -1272,19 +2161,31 @@ namespace dwarf
 			 : iterator_base(arg) {}
 			
 			iterator_df& operator=(const iterator_base& arg) 
-			{ this->base_reference() = arg; return *this; }
+			{ this->base_reference() = arg; m_ancestors.clear(); return *this; }
 			iterator_df& operator=(iterator_base&& arg) 
-			{ this->base_reference() = std::move(arg); return *this; }
+			{ this->base_reference() = std::move(arg); m_ancestors.clear(); return *this; }
 			
 			void increment()
 			{
 				Dwarf_Off start_offset = offset_here();
+				bool known = ancestors_known();
 				if (get_root().move_to_first_child(base_reference()))
 				{
 					// our offsets should only go up
 					assert(offset_here() > start_offset);
+					if (known) m_ancestors.push_back(start_offset);
+					else m_ancestors.clear();
 					return;
 				}
+				increment_skipping_subtree();
+			}
+			/* The same as increment, except we don't visit our children
+			 * (or theirs). move_to_next_sibling() jumps straight over them,
+			 * so this costs the same however big the subtree is, and if 
+			 * we know our ancestors, climbing out needs no topology. */
+			void increment_skipping_subtree()
+			{
+				Dwarf_Off start_offset = offset_here();
 				do
 				{
 					if (get_root().move_to_next_sibling(base_reference()))
@@ -1292,7 +2193,7 @@ namespace dwarf
 						assert(offset_here() > start_offset);
 						return;
 					}
-				} while (get_root().move_to_parent(base_reference()));
+				} while (move_to_parent_here());
 
 				// if we got here, there is nothing left in the tree...
 				// ... so set us to the end sentinel
@@ -1306,7 +2207,7 @@ namespace dwarf
 			bool equal(const self& arg) const { return this->base() == arg.base(); }
 			
 			DerefAs& dereference() const
-			{ return dynamic_cast<DerefAs&>(this->iterator_base::dereference()); }
+			{ return downcast_payload<DerefAs>(this->iterator_base::dereference()); }
 		};
 		/* assert that our opt<> specialization for subclasses of iterator_base 
 		 * has had its effect. */
@@ -1326,8 +2227,25 @@ namespace dwarf
 			typedef iterator_bf<DerefAs> self;
 			friend class boost::iterator_core_access;
 
-			// extra state needed!
-			deque< iterator_base > m_queue;
+			/* Extra state needed! The queue holds the first children we have
+			 * yet to visit, as (offset, depth). We only make a handle for 
+			 * each when we get to it, so a wide frontier doesn't pin libdwarf
+			 * DIEs (or, since copying a handle upgrades it, payloads), and 
+			 * copying us is cheap. */
+			deque< pair<Dwarf_Off, unsigned> > m_queue;
+			
+			void take_from_queue()
+			{
+				if (m_queue.size() > 0)
+				{
+					pair<Dwarf_Off, unsigned> next = m_queue.front(); m_queue.pop_front();
+					this->base_reference() = get_root().pos(next.first, next.second);
+				}
+				else
+				{
+					this->base_reference() = iterator_base::END;
+				}
+			}
 			
 			iterator_base& base_reference()
 			{ return static_cast<iterator_base&>(*this); }
@@ -1365,7 +2283,10 @@ namespace dwarf
 				//   ^-- might be END
 				
 				// we ALWAYS enqueue the first child
-				if (first_child != iterator_base::END) m_queue.push_back(first_child);
+				if (first_child != iterator_base::END)
+				{
+					m_queue.push_back(make_pair(first_child.offset_here(), first_child.depth()));
+				}
 				
 				if (get_root().move_to_next_sibling(this->base_reference()))
 				{
@@ -1375,14 +2296,7 @@ namespace dwarf
 				else
 				{
 					// no more siblings; use the queue
-					if (m_queue.size() > 0)
-					{
-						this->base_reference() = m_queue.front(); m_queue.pop_front();
-					}
-					else
-					{
-						this->base_reference() = iterator_base::END;
-					}
+					take_from_queue();
 				}
 			}
 			
@@ -1398,14 +2312,9 @@ namespace dwarf
 					// success -- don't enqueue children
 					return;
 				}
-				else if (m_queue.size() > 0)
-				{
-					this->base_reference() = m_queue.front(); m_queue.pop_front();
-					assert(!is_real_die_position() || offset_here() > 0);
-				}
 				else
 				{
-					this->base_reference() = iterator_base::END;
+					take_from_queue();
 					assert(!is_real_die_position() || offset_here() > 0);
 				}
 			}
@@ -1415,7 +2324,7 @@ namespace dwarf
 				assert(false); // FIXME
 			}
 			DerefAs& dereference() const
-			{ return dynamic_cast<DerefAs&>(this->iterator_base::dereference()); }
+			{ return downcast_payload<DerefAs>(this->iterator_base::dereference()); }
 		};
 		
 		template <typename DerefAs /* = basic_die*/>
@@ -1423,7 +2332,7 @@ namespace dwarf
 		                       public boost::iterator_facade<
 		                       iterator_sibs<DerefAs> /* I (CRTP) */
 		                     , DerefAs /* V */
-		                     , boost::forward_traversal_tag
+		                     , boost::bidirectional_traversal_tag
 		                     , DerefAs& //boost::use_default /* Reference */
 		                     , Dwarf_Signed /* difference */
 		                     >
@@ -1436,45 +2345,137 @@ namespace dwarf
 			const iterator_base& base() const
 			{ return static_cast<const iterator_base&>(*this); }
 			
-			iterator_sibs() : iterator_base()
+			/* An end iterator doesn't know where it is, so to be able to 
+			 * decrement it, we remember either the last sibling (if we got 
+			 * here by incrementing) or the parent (if children_here() made
+			 * us). Null p_end_root means we don't know. */
+			root_die *p_end_root;
+			Dwarf_Off end_prev_off;
+			unsigned end_prev_depth;
+			bool end_prev_is_parent;
+			
+			iterator_sibs() : iterator_base(), p_end_root(nullptr)
 			{}
 
 			iterator_sibs(const iterator_base& arg)
-			 : iterator_base(arg)
+			 : iterator_base(arg), p_end_root(nullptr)
 			{}
 
 			iterator_sibs(iterator_base&& arg)
-			 : iterator_base(std::move(arg))
+			 : iterator_base(std::move(arg)), p_end_root(nullptr)
 			{}
 			
+			/* The end of parent's children. */
+			static iterator_sibs end_of_children(const iterator_base& parent)
+			{
+				iterator_sibs end;
+				if (parent.is_root_position() || parent.is_real_die_position())
+				{
+					end.p_end_root = &parent.get_root();
+					end.end_prev_off = parent.is_root_position() ? 0UL : parent.offset_here();
+					end.end_prev_depth = parent.depth();
+					end.end_prev_is_parent = true;
+				}
+				return end;
+			}
+			
 			iterator_sibs& operator=(const iterator_base& arg) 
-			{ this->base_reference() = arg; return *this; }
+			{ this->base_reference() = arg; p_end_root = nullptr; return *this; }
 			iterator_sibs& operator=(iterator_base&& arg) 
-			{ this->base_reference() = std::move(arg); return *this; }
+			{ this->base_reference() = std::move(arg); p_end_root = nullptr; return *this; }
 			
 			void increment()
 			{
-				if (this->base_reference().get_root().move_to_next_sibling(this->base_reference()))
+				root_die& r = this->base_reference().get_root();
+				if (r.move_to_next_sibling(this->base_reference()))
 				{
 					return;
 				}
 				else 
 				{ 
-					this->base_reference() = this->base_reference().get_root().end/*<self>*/(); 
+					// we didn't move, so we can still see the last sibling
+					end_prev_off = this->offset_here();
+					end_prev_depth = this->depth();
+					end_prev_is_parent = false;
+					this->base_reference() = r.end/*<self>*/(); 
+					p_end_root = &r;
 					return; 
 				}
 			}
 			
 			void decrement()
 			{
-				assert(false);
+				if (this->is_end_position())
+				{
+					// we have to remember where we were
+					assert(p_end_root);
+					root_die& r = *p_end_root;
+					iterator_base prev = r.pos(end_prev_off, end_prev_depth);
+					if (end_prev_is_parent) prev = r.last_child(prev);
+					this->base_reference() = std::move(prev);
+					p_end_root = nullptr;
+					return;
+				}
+				if (!this->base_reference().get_root().move_to_prev_sibling(this->base_reference()))
+				{
+					assert(false); // no decrementing before the first sibling
+				}
 			}
 			
 			bool equal(const self& arg) const { return this->base() == arg.base(); }
 			DerefAs& dereference() const
-			{ return dynamic_cast<DerefAs&>(this->iterator_base::dereference()); }
+			{ return downcast_payload<DerefAs>(this->iterator_base::dereference()); }
 		};
 
+		/* The CUs' children, CU by CU. We hold only the current CU and our 
+		 * place among its children; we get to each CU's children when we 
+		 * get to that CU, so beginning is as cheap as ending. */
+		struct iterator_grandchildren : public boost::iterator_facade<
+		                                  iterator_grandchildren
+		                                , basic_die
+		                                , boost::forward_traversal_tag
+		                                , basic_die&
+		                                , Dwarf_Signed
+		                                >
+		{
+			friend class boost::iterator_core_access;
+			
+			iterator_base m_cu; // END when we're at the end
+			iterator_sibs<> m_child;
+			
+			iterator_grandchildren() {}
+			// start at cu's first child, or the first one after that
+			explicit iterator_grandchildren(iterator_base&& cu)
+			 : m_cu(std::move(cu))
+			{
+				if (m_cu != iterator_base::END) m_child = m_cu.get_root().first_child(m_cu);
+				skip_childless_cus();
+			}
+			
+			const iterator_sibs<>& base() const { return m_child; }
+			
+		private:
+			void skip_childless_cus()
+			{
+				while (m_child == iterator_base::END && m_cu != iterator_base::END)
+				{
+					root_die& r = m_cu.get_root();
+					if (!r.move_to_next_sibling(m_cu)) { m_cu = iterator_base::END; return; }
+					m_child = r.first_child(m_cu);
+				}
+			}
+			void increment()
+			{
+				if (m_cu.get_root().move_to_next_sibling(m_child.base_reference())) return;
+				m_child = iterator_base::END;
+				skip_childless_cus();
+			}
+			bool equal(const iterator_grandchildren& arg) const 
+			{ return m_child.base() == arg.m_child.base(); }
+			basic_die& dereference() const
+			{ return *m_child; }
+		};
+		
 		inline
 		sequence<iterator_sibs<basic_die> >
 		basic_die::children(optional_root_arg_decl) const
@@ -1603,7 +2604,9 @@ struct regs;
 		/* We most most of the resolution stuff into iterator_base, 
 		 * but leave this here so that payload implementations can
 		 * provide a faster-than-default (i.e. faster than linear search)
-		 * way to look up named children (e.g. hash table). */
+		 * way to look up named children (e.g. hash table). The default
+		 * uses the root's table of our children by name (see 
+		 * root_die::named_children_of()). */
 		virtual 
 		inline iterator_base
 		named_child(const std::string& name, optional_root_arg) const;
@@ -1643,7 +2646,7 @@ struct summary_code_word_t
 		}
 		return *this;
 	}
-	summary_code_word_t& operator<<(const string& s) 
+	summary_code_word_t& operator<<(string_view s) 
 	{
 		if (val)
 		{
@@ -1994,6 +2997,77 @@ friend class factory;
 /****************************************************************/
 /* end generated ADT includes                                   */
 /****************************************************************/
+		/* Now the classes exist, turn the generated tag relation into 
+		 * payload_tags<> specializations. The spec has a few artificial 
+		 * classes we don't define (e.g. with_instances), so each pred 
+		 * (re)declares its class; a specialization for an incomplete class
+		 * is fine, since nobody can ask is_a<> of it. The sets are 
+		 * constexpr (hence one big disjunction, which is all C++11 allows),
+		 * so filters on them cost a few compares on the tag, and can be
+		 * checked at compile time. */
+		template <>
+		struct payload_tags<basic_die>
+		{
+			static constexpr bool known = true;
+			static constexpr bool contains(Dwarf_Half tag) { return true; }
+		};
+#define begin_pred(fragment) \
+		struct fragment ## _die; \
+		template <> \
+		struct payload_tags<fragment ## _die> \
+		{ \
+			static constexpr bool known = true; \
+			static constexpr bool contains(Dwarf_Half tag) \
+			{ \
+				return false
+#define disjunct(tag_fragment) \
+					|| tag == DW_TAG_ ## tag_fragment
+#define end_pred(fragment) \
+					; \
+			} \
+		};
+#include "dwarf3-tagpreds.h"
+#undef begin_pred
+#undef disjunct
+#undef end_pred
+		static_assert(payload_tags<member_die>::contains(DW_TAG_member)
+			&& payload_tags<type_die>::contains(DW_TAG_structure_type)
+			&& !payload_tags<type_die>::contains(DW_TAG_variable),
+			"generated tag sets disagree with the spec");
+		/* Downcasting through a virtual base. The factory makes exactly
+		 * name_die for a file DIE tagged DW_TAG_name, so if the typeid 
+		 * agrees, the complete object is a name_die, and from there, 
+		 * getting to any of its bases is static. Finding the complete 
+		 * object (dynamic_cast<void *>) only reads an offset from the 
+		 * vtable, and the typeid check is a compare, so this skips 
+		 * dynamic_cast<To&>'s walk of the class hierarchy. Anything else 
+		 * (in-memory DIEs, other factories' classes) still gets that. */
+		template <typename To, typename Made>
+		inline To *upcast_made(void *p_complete, std::true_type /* Made is a To */)
+		{ return static_cast<Made *>(p_complete); }
+		template <typename To, typename Made>
+		inline To *upcast_made(void *p_complete, std::false_type)
+		{ return nullptr; }
+		template <typename To>
+		inline To& downcast_payload(basic_die& arg, std::false_type /* virtual base */)
+		{
+			To *p = nullptr;
+			switch (arg.get_tag())
+			{
+#define factory_case(name, ...) \
+				case DW_TAG_ ## name: \
+					if (typeid(arg) == typeid(name ## _die)) p = upcast_made<To, name ## _die>( \
+						dynamic_cast<void *>(&arg), std::is_base_of<To, name ## _die>()); \
+					break;
+#include "dwarf3-factory.h"
+#undef factory_case
+				default: break;
+			}
+#ifdef DWARFPP_CHECK_TAG_PREDS
+			assert(!p || p == &dynamic_cast<To&>(arg));
+#endif
+			return p ? *p : dynamic_cast<To&>(arg);
+		}
 		/* root_die's name resolution functions */
 		template <typename Iter>
 		inline void 
@@ -2053,9 +3127,41 @@ friend class factory;
 				i_cached != matching_cached.second; 
 				++i_cached)
 			{
+				hit_in_cache.insert(i_cached->second);
 				recurse(pos(i_cached->second, 2));
 				if (max != 0 && results.size() >= max) return;
 			}
+			
+			/* If there's an accelerator table, try it first. If its answer
+			 * is complete and every candidate checked out, we needn't scan;
+			 * otherwise the scan below picks up the rest (skipping anything 
+			 * we've already seen). */
+			vector<Dwarf_Off> accelerated;
+			if (!visible_named_grandchildren_is_complete)
+			{
+				bool complete = accelerated_grandchildren_named(*path_pos, accelerated);
+				for (auto i_off = accelerated.begin(); i_off != accelerated.end(); ++i_off)
+				{
+					if (hit_in_cache.find(*i_off) != hit_in_cache.end()) continue;
+					/* The tables can list things that aren't grandchildren
+					 * (e.g. members of namespaces), so check. If one of these 
+					 * is wrong, don't trust the rest of the answer either. */
+					iterator_base i = find(*i_off);
+					if (!i || i.depth() != 2) { complete = false; continue; }
+					auto name = i.name_view_here();
+					if (!name || *name != *path_pos) { complete = false; continue; }
+					hit_in_cache.insert(*i_off);
+					visible_named_grandchildren.insert(make_pair(
+						string(name->begin(), name->end()), *i_off));
+					if (!i.has_attr_here(DW_AT_visibility) 
+						|| i.attr(DW_AT_visibility) != DW_VIS_local)
+					{
+						recurse(i);
+						if (max != 0 && results.size() >= max) return;
+					}
+				}
+				if (complete) return;
+			}
 
 			/* Now we have to be exhaustive. But don't bother if we know that 
 			 * our cache is exhaustive. */
@@ -2076,16 +3182,17 @@ friend class factory;
 					/* skip any we saw before */
 					if (hit_in_cache.find(i_g.base().base().offset_here()) != hit_in_cache.end()) continue;
 
-					if (i_g.base().base().name_here())
+					auto name = i_g.base().base().name_view_here();
+					if (name)
 					{
 						/* install in cache */
-						string name = *i_g.base().base().name_here();
 						visible_named_grandchildren.insert(
-							make_pair(name, i_g.base().base().offset_here()
+							make_pair(string(name->begin(), name->end()), 
+								i_g.base().base().offset_here()
 							)
 						);
 
-						if (name == *path_pos
+						if (*name == *path_pos
 							&& (
 								!i_g.base().base().has_attr_here(DW_AT_visibility) 
 								|| i_g.base().base().attr(DW_AT_visibility) != DW_VIS_local
@@ -2100,8 +3207,9 @@ friend class factory;
 				}
 			}
 			
-			/* If we got here, we searched everything. */
-			visible_named_grandchildren_is_complete = true;
+			/* If we got here, we searched everything. (Concurrent readers 
+			 * only get here if it's already true; don't write it again.) */
+			if (!visible_named_grandchildren_is_complete) visible_named_grandchildren_is_complete = true;
 		}
 
 		inline iterator_base 
@@ -2165,36 +3273,15 @@ friend class factory;
 		inline iterator_base
 		with_named_children_die::named_child(const std::string& name, optional_root_arg_decl) const
 		{
-			/* The default implementation just asks the root. Since we've somehow 
-			 * been called via the payload, we have the added inefficiency of 
-			 * searching for ourselves first. This shouldn't happen, though 
-			 * I'm not sure if we explicitly avoid it. Warn. */
-#ifdef DWARFPP_WARN_ON_INEFFICIENT_USAGE
-			cerr << "Warning: inefficient usage of with_named_children_die::named_child" << endl;
-#endif
-			/* NOTE: the idea about payloads knowing about their children is 
-			 * already dodgy because it breaks our "no knowledge of structure" 
-			 * property. We can likely work around this by requiring that named_child 
-			 * implementations call back to the root if they fail, i.e. that the root
-			 * is allowed to know about structure which the child doesn't. 
-			 * Or we could call into the root to "validate" our view, somehow, 
-			 * to support the case where a given root "hides" some DIEs.
-			 * This might be a method
-			 * 
-			 *  iterator_base 
-			 *  root_die::check_named_child(const iterator_base& found, const std::string& name)
-			 * 
-			 * which calls around into find_named_child if the check fails. 
-			 * 
-			 * i.e. the root_die has a final say, but the payload itself "hints"
-			 * at the likely answer. So the payload can avoid find_named_child's
-			 * linear search in the common case, but fall back to it in weird
-			 * scenarios (deletions). 
-			 */
+			/* The root keeps a hash table from our children's names to
+			 * their offsets, built on the first lookup. Thereafter, each
+			 * lookup is a hash probe and a find() of the child. */
 			root_die& r = get_root(opt_r);
-			Dwarf_Off off = get_offset();
-			auto start_iter = r.find(off);
-			return r.find_named_child(start_iter, name); 
+			const root_die::named_children_table *p_table = r.named_children_of(get_offset());
+			if (!p_table) return r.find_named_child(r.find(get_offset()), name);
+			auto found = p_table->find(name);
+			if (found == p_table->end()) return iterator_base::END;
+			return r.find(found->second.front());
 		}
 
 		// now compile_unit_die is complete...
@@ -2218,17 +3305,15 @@ friend class factory;
 		pair<root_die::grandchildren_iterator, root_die::grandchildren_iterator>
 		root_die::grandchildren() const
 		{
-			auto p_seq = std::make_shared<srk31::concatenating_sequence< iterator_sibs<> > >();
-			auto cu_seq = children();
-			for (auto i_cu = std::move(cu_seq.first); i_cu != cu_seq.second; ++i_cu)
-			{
-				pair<iterator_sibs<>, iterator_sibs<> > children_seq = i_cu.base().base().children_here();
-				p_seq->append(std::move(children_seq.first), std::move(children_seq.second));
-			}
-			return make_pair(p_seq->begin(), p_seq->end());
+			root_die& r = const_cast<root_die&>(*this);
+			return make_pair(
+				iterator_grandchildren(r.first_child(r.begin())),
+				iterator_grandchildren()
+			);
 		}
 		inline std::string compile_unit_die::source_file_name(unsigned o) const
 		{
+			auto guard = shared_guard();
 			StringList names(d);
 			//if (!names) throw Error(current_dwarf_error, 0);
 			/* Source file numbers in DWARF are indexed starting from 1. 
@@ -2245,6 +3330,7 @@ friend class factory;
 		inline unsigned compile_unit_die::source_file_count() const
 		{
 			// FIXME: cache some stuff
+			auto guard = shared_guard();
 			StringList names(d);
 			return names.get_len();
 		}
@@ -2298,26 +3384,18 @@ friend class factory;
 		{
 			raw_handle_type returned;
 			
-			if (!dynamic_cast<Die *>(&it.get_handle())) return handle_type(nullptr, deleter(nullptr, r));
+			Die *p_d = it.libdwarf_handle();
+			if (!p_d) return handle_type(nullptr, deleter(nullptr, r));
 			
+			/* The sibling comes from the same Debug as p_d, which need not
+			 * be r.dbg if we have concurrent readers. */
 			int ret
-			 = dwarf_siblingof(r.dbg.handle.get(), dynamic_cast<Die&>(it.get_handle()).handle.get(), 
+			 = dwarf_siblingof(p_d->get_dbg(), p_d->handle.get(), 
 			 	&returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK)
 			{	
-				// also update the parent cache
-				GET_HANDLE_OFFSET;
-				auto found = r.parent_of.find(it.offset_here());
-				if (found != r.parent_of.end())
-				{
-					// parent of the sibling is the same as parent of "it"
-					r.parent_of[off] = found->second;
-				} else cerr << "Warning: parent cache did not know 0x" << std::hex << it.offset_here() << std::dec << endl;
-				
-				// first_child_of, next_sibling_of
-				r.next_sibling_of[it.offset_here()] = off;
-				
-				return handle_type(returned, deleter(r.dbg.handle.get(), r));
+				// no need to update any caches -- the CU's topology has this edge
+				return handle_type(returned, deleter(p_d->get_dbg(), r));
 			}
 			else return handle_type(nullptr, deleter(nullptr, r));
 		}
@@ -2332,12 +3410,7 @@ friend class factory;
 			 = dwarf_siblingof(r.dbg.handle.get(), nullptr, &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK)
 			{
-				// update parent cache
-				GET_HANDLE_OFFSET;
-				r.parent_of[off] = 0UL;
-				
 				// the *caller* updates first_child_of, next_sibling_of
-				
 				return handle_type(returned, deleter(r.dbg.handle.get(), r));
 			}
 			else return handle_type(nullptr, deleter(nullptr, r));
@@ -2348,16 +3421,14 @@ friend class factory;
 			raw_handle_type returned;
 			root_die& r = it.get_root();
 			
-			if (!dynamic_cast<Die *>(&it.get_handle())) return handle_type(nullptr, deleter(nullptr, r));
+			Die *p_d = it.libdwarf_handle();
+			if (!p_d) return handle_type(nullptr, deleter(nullptr, r));
 
-			int ret = dwarf_child(dynamic_cast<Die&>(it.get_handle()).handle.get(), &returned, &current_dwarf_error);
+			int ret = dwarf_child(p_d->handle.get(), &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK)
 			{
-				GET_HANDLE_OFFSET;
-				r.parent_of[off] = it.offset_here();
-				// first_child_of, next_sibling_of
-				r.first_child_of[it.offset_here()] = off;
-				return handle_type(returned, deleter(it.get_root().dbg.handle.get(), r));
+				// again, the CU's topology has this edge
+				return handle_type(returned, deleter(p_d->get_dbg(), r));
 			}
 			else return handle_type(nullptr, deleter(nullptr, r));
 
@@ -2369,11 +3440,12 @@ friend class factory;
 			
 			if (!r.dbg.handle) return handle_type(nullptr, deleter(nullptr, r));
 
-			int ret = dwarf_offdie(r.dbg.handle.get(), off, &returned, &current_dwarf_error);
+			Dwarf_Debug dbg = r.dbg_for_this_thread();
+			int ret = dwarf_offdie(dbg, off, &returned, &current_dwarf_error);
 			if (ret == DW_DLV_OK)
 			{
 				// can't update parent cache
-				return handle_type(returned, deleter(r.dbg.handle.get(), r));
+				return handle_type(returned, deleter(dbg, r));
 			}
 			else return handle_type(nullptr, deleter(nullptr, r));
 		}
@@ -2447,9 +3519,9 @@ friend class factory;
 // 				// return nearest_enclosing(DW_TAG_compile_unit).spec_here();
 		
 		}
-		/* NOTE: pos() is incompatible with a strict parent cache.
-		 * But it is necessary to support following references.
-		 * We fill in the parent if depth <= 2, or if the user can tell us. */
+		/* NOTE: pos() used to be incompatible with a strict parent cache.
+		 * Now that parents come from the per-CU topology, we don't need 
+		 * to record anything here. parent_off is kept for compatibility. */
 		template <typename Iter /* = iterator_df<> */ >
 		inline Iter root_die::pos(Dwarf_Off off, unsigned depth,
 			optional<Dwarf_Off> parent_off /* = optional<Dwarf_Off>() */,
@@ -2457,51 +3529,124 @@ friend class factory;
 		{
 			if (depth == 0) { assert(off == 0UL); assert(!referencer); return Iter(begin()); }
 			
-			// always check the sticky set first
-			auto found = sticky_dies.find(off);
-			if (found != sticky_dies.end())
+			// CUs we've seen before are in the CU table, which is cheaper still
+			if (depth == 1)
+			{
+				const cu_header_info *p_h = cu_header_for(off);
+				basic_die *p_cu = p_h ? p_h->p_payload.load() : nullptr;
+				if (p_cu)
+				{
+					if (referencer) refers_to.set(*referencer, off);
+					return Iter(iterator_base(ptr_type(p_cu), 1, *this));
+				}
+			}
+			
+			// always check the sticky set first; we're told the depth, so
+			// there's no need to climb (find_upwards()) to work it out
+			auto found = find_sticky(off);
+			if (found)
 			{
-				// it's there, so use find_upwards to get the iterator
-				assert(found->second);
-				return find_upwards(off, found->second);
+				if (referencer) refers_to.set(*referencer, off);
+				return Iter(iterator_base(static_cast<abstract_die&&>(*found), depth, *this));
 			}
 			
 			auto handle = Die::try_construct(*this, off);
 			assert(handle);
 			iterator_base base(Die(std::move(handle)), depth, *this);
 			
-			if (depth == 1) parent_of[off] = 0UL;
-			else if (depth == 2) parent_of[off] = base.enclosing_cu_offset_here();
-			else if (parent_off) parent_of[off] = *parent_off;
-			
-			// do we know anything about the first_child_of and next_sibling_of?
-			// NO because we don't know where we are w.r.t. other siblings
-			
-			if (base && referencer) refers_to[*referencer] = base.offset_here();
+			if (base && referencer) refers_to.set(*referencer, base.offset_here());
 			
 			return Iter(std::move(base));
 		}		
 		
+		template <typename T>
+		inline vector<T> root_die::parallel_collect_from_cus(
+			std::function<void(const iterator_df<compile_unit_die>&, vector<T>&)> fn,
+			unsigned nthreads)
+		{
+			concurrent_section section;
+			vector<traversal_unit> units = prepare_parallel(false, nthreads, section);
+			vector<vector<T> > collected(units.size());
+			run_work_stealing(units.size(), [this, &units, &collected, &fn](unsigned i, unsigned) {
+				fn(cu_pos(units[i].cu_offset), collected[i]);
+			}, nthreads);
+			vector<T> out;
+			for (auto i_c = collected.begin(); i_c != collected.end(); ++i_c)
+			{
+				std::move(i_c->begin(), i_c->end(), std::back_inserter(out));
+			}
+			return out;
+		}
+		
+		template <typename T>
+		inline vector<T> root_die::parallel_collect_dies(
+			std::function<bool(const iterator_base&)> pred,
+			std::function<T(const iterator_base&)> fn,
+			unsigned nthreads)
+		{
+			concurrent_section section;
+			vector<traversal_unit> units = prepare_parallel(true, nthreads, section);
+			vector<vector<T> > collected(units.size());
+			run_work_stealing(units.size(), [this, &units, &collected, &pred, &fn](unsigned i, unsigned) {
+				vector<T>& here = collected[i];
+				walk_unit(units[i], pred, [&here, &fn](const iterator_base& it) {
+					here.push_back(fn(it));
+				});
+			}, nthreads);
+			vector<T> out;
+			for (auto i_c = collected.begin(); i_c != collected.end(); ++i_c)
+			{
+				std::move(i_c->begin(), i_c->end(), std::back_inserter(out));
+			}
+			return out;
+		}
+		
 		template <typename Iter /* = iterator_df<> */ >
 		inline Iter root_die::find_upwards(Dwarf_Off off, root_die::ptr_type maybe_ptr)
 		{
-			/* Use the parent cache to verify our existence and
-			 * get our depth. */
-			int height = -1;
+			/* Use the topologies and the parent cache to verify our existence
+			 * and get our depth. In-memory DIEs are found in the parent cache, 
+			 * but their ancestors may be libdwarf-backed, so we may switch from
+			 * the latter to the former part-way up. */
+			unsigned height = 0;
 			Dwarf_Off cur = off;
-			map<Dwarf_Off, Dwarf_Off>::iterator i_found_parent;
-			do
+			while (cur != 0UL)
 			{
-				i_found_parent = parent_of.find(cur);
+				const cu_topology *p_t = topology_containing(cur);
+				cu_topology::ordinal_t o = p_t ? p_t->ordinal_of(cur) : cu_topology::NONE;
+				if (o != cu_topology::NONE)
+				{
+					height += p_t->depth_of(o);
+					cur = 0UL;
+					break;
+				}
+				// CUs whose topology we haven't built are in the header table
+				if (cu_header_for(cur))
+				{
+					height += 1;
+					cur = 0UL;
+					break;
+				}
+				// file DIEs that find_downwards() stepped over
+				optional<Dwarf_Off> descended = descent_parent_of(cur);
+				if (descended)
+				{
+					cur = *descended;
+					++height;
+					continue;
+				}
+				auto i_found_parent = parent_of.find(cur);
+				if (i_found_parent == parent_of.end()) break;
+				cur = i_found_parent->second;
 				++height;
-			} while (i_found_parent != parent_of.end() && (cur = i_found_parent->second, true));
+			}
 			
 			// if we got all the way to the root, cur will be 0
 			if (cur == 0)
 			{
 				// CARE: this recursion is safe because pos never calls back to us
 				// with a non-null maybe_ptr
-				if (!maybe_ptr) return pos(off, height, parent_of[off]);
+				if (!maybe_ptr) return pos(off, height);
 				else return iterator_base(static_cast<abstract_die&&>(*maybe_ptr), height, *this);
 			} 
 			else return iterator_base::END;
@@ -2511,21 +3656,37 @@ friend class factory;
 		inline Iter root_die::find(Dwarf_Off off, 
 			opt<pair<Dwarf_Off, Dwarf_Half> > referencer /* = opt<pair<Dwarf_Off, Dwarf_Half> >() */)
 		{
+			/* If off's CU has a topology, or off is a CU or something an
+			 * earlier find_downwards() stepped over, this is all we need.
+			 * Otherwise we steer down to it (see find_downwards()), which
+			 * also validates off, i.e. tells us whether it's really the
+			 * offset of a DIE. We don't build the topology for this: that
+			 * would mean walking the whole CU. */
 			Iter found_up = find_upwards(off);
 			if (found_up != iterator_base::END)
 			{
-				if (referencer) refers_to[*referencer] = found_up.offset_here();
+				if (referencer) refers_to.set(*referencer, found_up.offset_here());
 				return found_up;
 			} 
 			else
 			{
 				auto found = find_downwards(off);
-				if (found && referencer) refers_to[*referencer] = found.offset_here();
+				if (found && referencer) refers_to.set(*referencer, found.offset_here());
 				return found;
 			}
 		}
 		
-		/* We use the properties of diesets to avoid a naive depth-first search. 
+		/* Offsets are ordered depth-first, so a DIE's subtree is exactly the
+		 * offsets from its own up to (not including) its next sibling's.
+		 * We steer by that: at each level, step along the siblings to the 
+		 * last one starting at or before off, then go down into it. At CU
+		 * level the header table takes us straight to the right CU.
+		 * In-memory DIEs are issued offsets in the same order (see
+		 * fresh_offset_under()), so they are found the same way.
+		 * Each file DIE we step over has its parent recorded (see
+		 * descent_parents), so later finds and parent() calls needn't
+		 * build the CU's topology, and a later descent into the same CU
+		 * picks up from the last DIE it already knows at or before off.
 		 * FIXME: make it work with encap::-style less strict ordering. 
 		 * NOTE: a possible idea here is to support a kind of "fractional offsets"
 		 * where we borrow *high-order* bits from the offset space in a dynamic
@@ -2537,94 +3698,75 @@ friend class factory;
 		template <typename Iter /* = iterator_df<> */ >
 		inline Iter root_die::find_downwards(Dwarf_Off off)
 		{
-			/* Interesting problem: our iterators don't make searching a subtree 
-			 * easy. I think there is a neat way of expressing this by combining
-			 * dfs and bfs traversal. FIXME: work out the recipe. */
-			
-			/* I think we want bf traversal with a smart subtree-skipping test. */
-			iterator_bf<typename Iter::DerefType> pos = begin();
-			// cerr << "Searching for offset " << std::hex << off << std::dec << endl;
-			// cerr << "Beginning search at 0x" << std::hex << pos.offset_here() << std::dec << endl;
-			while (pos != iterator_base::END && pos.offset_here() != off)
-			{
-				/* What's next in the breadth-first order? */
-				assert(((void)pos.offset_here(), true));
-				// cerr << "Began loop body; pos is 0x" 
-				// 	<< std::hex << pos.offset_here() << std::dec;
-				iterator_bf<typename Iter::DerefType> next_pos = pos; 
-				assert(((void)pos.offset_here(), true));
-				next_pos.increment();
-				assert(((void)pos.offset_here(), true));
-				// cerr << ", next_pos is ";
-				// if (next_pos != iterator_base::END) {
-				// 	cerr << std::hex << next_pos.offset_here() << std::dec;
-				//} else cerr << "(END)";
-				// cerr << endl;
-				 
-				/* Does the move pos->next_pos skip over (enqueue) a subtree? 
-				 * If so, the depth will stay the same. 
-				 * If no, it's because we took a previously enqueued (deeper, but earlier) 
-				 * node out of the queue (i.e. descended instead of skipped-over). */
-				if (next_pos != iterator_base::END && next_pos.depth() == pos.depth())
+			iterator_base cur = iterator_base::END;
+			ensure_cu_headers();
+			cu_header_info key; key.cu_offset = off;
+			auto i_h = std::upper_bound(cu_headers.begin(), cu_headers.end(), key);
+			if (i_h != cu_headers.begin())
+			{
+				/* The last CU starting at or before off. We'll still step 
+				 * along from it, in case off is in a later in-memory CU. */
+				Dwarf_Off cu_off = (i_h - 1)->cu_offset;
+				/* If we've built the CU's topology, it knows. But we don't
+				 * build it here: next_sibling() hops over whole subtrees 
+				 * (by DW_AT_sibling, or in the native reader), so the walk
+				 * below touches only the DIEs on the way down and their
+				 * earlier siblings. */
+				const cu_topology *p_t = topology_containing(cu_off);
+				if (p_t && p_t->ordinal_of(off) != cu_topology::NONE)
 				{
-					// cerr << "next_pos is at same depth..." << endl;
-					// if I understand correctly....
-					assert(next_pos.offset_here() > pos.offset_here());
-					
-					/* Might that subtree contain off? */
-					if (off < next_pos.offset_here() && off > pos.offset_here())
-					{
-						// cerr << "We think that target is in subtree ..." << endl;
-						/* Yes. We want that subtree. 
-						 * We don't want to move_to_first_child, 
-						 * because that will put the bfs traversal in a weird state
-						 * (s.t. next_pos might take us *upwards* not just across/down). 
-						 * But we don't want to increment through everything, 
-						 * because that will be slow. 
-						 * Instead, 
-						 * - create a new bf iterator at pos (with empty queue); 
-						 * - increment it once normally, so that the subtree is enqueued; 
-						 * - continue the loop. */
-						iterator_bf<typename Iter::DerefType> new_pos 
-						 = static_cast<iterator_base>(pos); 
-						new_pos.increment();
-						if (new_pos != iterator_base::END) {
-							//  previously I had the following slow code: 
-							// //do { pos.increment(); } while (pos.offset_here() > off); 
-							pos = new_pos;
-							// cerr << "Fast-forwarded pos to " 
-							// 	<< std::hex << pos.offset_here() << std::dec << std::endl;
-							continue;
-						} 
-						else 
-						{
-							// subtree is empty -- we have failed
-							pos = iterator_base::END;
-							continue;
-						}
-						
-					}
-					else // off >= next_pos.offset_here() || off <= pos.offset_here()
-					{
-						// cerr << "Subtree between pos and next_pos cannot possibly contain target..." << endl;
-						/* We can't possibly want that subtree. */
-						pos.increment_skipping_subtree();
-						continue;
-					}
+					return find_upwards<Iter>(off);
 				}
-				else 
-				{ 
-					// next is END, or is at a different (lower) depth than pos
-					pos.increment(); 
-					continue; 
+				cur = pos(cu_off, 1);
+			}
+			else cur = first_child(begin());
+			
+			Dwarf_Off cu_here = 0UL;
+			Dwarf_Off parent_here = 0UL; // whose children we're stepping along
+			bool recording = false;
+			auto record = [this, &cu_here, &parent_here, &recording](const iterator_base& d) {
+				if (recording && d.libdwarf_handle()) descent_parents[cu_here][d.offset_here()] = parent_here;
+			};
+			/* Where an earlier descent got to, and how much of it we're
+			 * still following. */
+			vector<Dwarf_Off> known_path;
+			unsigned next_known = 0;
+			while (cur != iterator_base::END)
+			{
+				if (cur.offset_here() > off) break; // off is before our first child
+				record(cur);
+				for (;;)
+				{
+					if (cur.offset_here() == off) return cur;
+					iterator_base next = next_sibling(cur);
+					if (next == iterator_base::END || next.offset_here() > off) break;
+					cur = std::move(next);
+					record(cur);
+				}
+				/* If off is anywhere, it's in cur's subtree. */
+				parent_here = cur.offset_here();
+				unsigned child_depth = cur.depth() + 1;
+				if (child_depth == 2)
+				{
+					cu_here = parent_here;
+					recording = !concurrent_readers && cu_header_for(cu_here)
+						&& !topology_containing(cu_here);
+					known_path = descent_path_before(cu_here, off);
+				}
+				/* Skip the siblings we stepped over last time, if we're
+				 * still on that path. */
+				if (next_known < known_path.size()
+					&& (next_known == 0 ? cu_here : known_path[next_known - 1]) == parent_here)
+				{
+					cur = pos(known_path[next_known++], child_depth);
+				}
+				else
+				{
+					next_known = known_path.size();
+					cur = first_child(cur);
 				}
-				assert(false); // i.e. the above cases must cover everything
 			}
-			// cerr << "Search returning "; 
-			// if (pos == iterator_base::END) cerr << "(END)";
-			// else cerr << std::hex << pos.offset_here() << std::dec; 
-			// cerr << endl;
-			return pos;
+			return iterator_base::END;
 		}
 		inline Attribute::handle_type 
 		Attribute::try_construct(const Die& h, Dwarf_Half attr)
@@ -2912,7 +4054,7 @@ friend class factory;
 		{
 			return std::make_pair<iterator_sibs<>, iterator_sibs<> >(
 				p_root->first_child(*this), 
-				iterator_base::END
+				iterator_sibs<>::end_of_children(*this)
 			);
 		}
 		inline sequence< iterator_sibs<> >
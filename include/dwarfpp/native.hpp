@@ -0,0 +1,373 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * native.hpp: a zero-copy DIE reader that decodes .debug_info itself,
+ * and a lazy view of a DIE's attributes that uses it where it can.
+ *
+ * Copyright (c) 2014, Stephen Kell.
+ */
+
+#ifndef DWARFPP_NATIVE_HPP_
+#define DWARFPP_NATIVE_HPP_
+
+#include <map>
+#include <tuple>
+#include <cstring>
+#include "lib.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		/* One attribute's value, decoded but not yet interpreted. Offsets
+		 * from reference forms are already section-relative. */
+		struct native_value
+		{
+			Dwarf_Half form; // after following DW_FORM_indirect
+			Dwarf_Unsigned u;
+			Dwarf_Signed s;  // sign-extended, for forms where that makes sense
+			const unsigned char *block; // for block, exprloc and data16 forms
+			Dwarf_Unsigned block_len;
+			const char *str; // for string forms; null if we couldn't find it
+			bool resolved;   // false for an index (strx, addrx) we couldn't look up
+		};
+
+		/* What the native reader throws when a DIE's attribute values run
+		 * past the end of its unit, where libdwarf would give us 
+		 * DW_DLV_ERROR (and we'd throw Error). */
+		struct Malformed_die
+		{
+			Dwarf_Off off; // where the value that doesn't fit starts
+			Malformed_die(Dwarf_Off off) : off(off) {}
+		};
+
+		/* The native reader maps the file read-only and walks .debug_info
+		 * itself, using abbreviation tables that it decodes once, up front.
+		 * So stepping from one DIE to the next allocates nothing and makes
+		 * no libdwarf calls, and a DIE handle is just a few pointers. We only
+		 * do linked executables and shared objects, not relocatable files
+		 * (whose .debug_info needs relocating), and only sections that are
+		 * neither compressed nor of the wrong byte order; usable() says
+		 * whether we managed. Once built, the reader is never modified, so
+		 * any number of threads may share it. */
+		struct native_reader
+		{
+			struct abbrev
+			{
+				Dwarf_Half tag;
+				bool has_children;
+				vector<Dwarf_Half> attrs;
+				vector<Dwarf_Half> forms;
+				vector<Dwarf_Signed> implicit_consts; // only meaningful for DW_FORM_implicit_const
+				int sibling_index; // of DW_AT_sibling in attrs, or -1
+				int fixed_size;    // size of all the attribute values, if that's fixed; else -1
+			};
+			struct abbrev_table
+			{
+				/* Compilers number their abbreviations 1..n, so index by code;
+				 * anything else goes in the map. */
+				vector<abbrev> dense;
+				map<Dwarf_Unsigned, abbrev> sparse;
+				const abbrev *find(Dwarf_Unsigned code) const
+				{
+					if (code - 1 < dense.size()) return &dense[code - 1];
+					auto found = sparse.find(code);
+					return (found == sparse.end()) ? nullptr : &found->second;
+				}
+			};
+			struct unit
+			{
+				Dwarf_Off header_offset;
+				Dwarf_Off die_offset;  // of the CU DIE
+				Dwarf_Off end_offset;  // first offset past the end of this unit
+				Dwarf_Half version;
+				unsigned char address_size;
+				unsigned char offset_size;
+				Dwarf_Unsigned str_offsets_base; // DWARF 5's, or 0 if none
+				Dwarf_Unsigned addr_base;        // likewise
+				const abbrev_table *p_abbrevs;
+			};
+
+			native_reader(int fd, ::Elf *e);
+			~native_reader();
+			bool usable() const { return ok; }
+			const vector<unit>& units() const { return m_units; }
+			const unit *unit_containing(Dwarf_Off off) const;
+
+			const unsigned char *info_at(Dwarf_Off off) const { return info + off; }
+			Dwarf_Off offset_of(const unsigned char *p) const { return p - info; }
+
+			/* Decode attribute i of a DIE with abbreviation a, whose value
+			 * starts at p, returning where the next one starts. Throws
+			 * Malformed_die if the value would run past the unit's end. */
+			const unsigned char *read_value(const unit& u, const abbrev& a, unsigned i,
+				const unsigned char *p, native_value& out) const;
+			const unsigned char *skip_values(const unit& u, const abbrev& a,
+				const unsigned char *p) const
+			{
+				if (a.fixed_size >= 0)
+				{
+					if (a.fixed_size > info_at(u.end_offset) - p) throw Malformed_die(offset_of(p));
+					return p + a.fixed_size;
+				}
+				native_value ignored;
+				for (unsigned i = 0; i < a.forms.size(); ++i) p = read_value(u, a, i, p, ignored);
+				return p;
+			}
+
+			/* Does a LEB128 number starting at p end before limit? */
+			static bool leb128_fits(const unsigned char *p, const unsigned char *limit)
+			{
+				while (p < limit) if (!(*p++ & 0x80)) return true;
+				return false;
+			}
+			static const unsigned char *read_uleb128(const unsigned char *p, Dwarf_Unsigned& out)
+			{
+				Dwarf_Unsigned result = 0;
+				unsigned shift = 0;
+				unsigned char byte;
+				do
+				{
+					byte = *p++;
+					if (shift < 64) result |= (Dwarf_Unsigned) (byte & 0x7f) << shift;
+					shift += 7;
+				} while (byte & 0x80);
+				out = result;
+				return p;
+			}
+			static const unsigned char *read_sleb128(const unsigned char *p, Dwarf_Signed& out)
+			{
+				Dwarf_Unsigned result = 0;
+				unsigned shift = 0;
+				unsigned char byte;
+				do
+				{
+					byte = *p++;
+					if (shift < 64) result |= (Dwarf_Unsigned) (byte & 0x7f) << shift;
+					shift += 7;
+				} while (byte & 0x80);
+				if (shift < 64 && (byte & 0x40)) result |= ~(Dwarf_Unsigned) 0 << shift;
+				out = (Dwarf_Signed) result;
+				return p;
+			}
+			/* Fixed-size little things, in our own byte order (we've checked
+			 * that it's the file's). */
+			static Dwarf_Unsigned read_sized(const unsigned char *p, unsigned size)
+			{
+				switch (size)
+				{
+					case 1: return *p;
+					case 2: { uint16_t v; memcpy(&v, p, 2); return v; }
+					case 4: { uint32_t v; memcpy(&v, p, 4); return v; }
+					case 8: { uint64_t v; memcpy(&v, p, 8); return v; }
+					case 3: {
+						/* only for strx3 and addrx3 */
+						uint32_t v = 0; memcpy(&v, p, 3); return v;
+					}
+					default: assert(false); return 0;
+				}
+			}
+
+		private:
+			bool ok;
+			void *mapping;
+			size_t mapping_len;
+			const unsigned char *info;        size_t info_len;
+			const unsigned char *abbrev_data; size_t abbrev_len;
+			const char *str;                  size_t str_len;
+			const char *line_str;             size_t line_str_len;
+			const unsigned char *str_offsets; size_t str_offsets_len;
+			const unsigned char *addr;        size_t addr_len;
+			/* Units that share an abbreviation table share its decoding, as
+			 * long as they agree on the sizes that fixed_size depends on. */
+			map<std::tuple<Dwarf_Off, unsigned char, unsigned char, Dwarf_Half>, abbrev_table> abbrev_tables;
+			vector<unit> m_units;
+
+			bool read_abbrevs(Dwarf_Off off, const unit& u, abbrev_table& out);
+			const char *string_at(const char *sec, size_t len, Dwarf_Unsigned off) const
+			{ return (sec && off < len) ? sec + off : nullptr; }
+
+			native_reader(const native_reader&) = delete;
+			native_reader& operator=(const native_reader&) = delete;
+		};
+
+		/* A DIE as the native reader sees it. This is a plain value: copying
+		 * it is free, and nothing needs freeing when it goes away. A null
+		 * native_die (no abbreviation) is what we get at the end of a list
+		 * of siblings. It implements abstract_die; for attributes whose
+		 * values we don't decode ourselves (location and range lists,
+		 * expressions, indexes we couldn't resolve), copy_attrs() asks
+		 * libdwarf, via a Die made at our offset. */
+		struct native_die : abstract_die
+		{
+			const native_reader *p_reader;
+			const native_reader::unit *p_unit;
+			const native_reader::abbrev *p_abbrev;
+			const unsigned char *attrs; // first attribute value
+			Dwarf_Off off;
+
+			native_die() : p_reader(nullptr), p_unit(nullptr), p_abbrev(nullptr), attrs(nullptr), off(0UL) {}
+			/* Decode the DIE header at p. */
+			native_die(const native_reader& r, const native_reader::unit& u, const unsigned char *p)
+			 : p_reader(&r), p_unit(&u), p_abbrev(nullptr), attrs(nullptr), off(r.offset_of(p))
+			{
+				if (p >= r.info_at(u.end_offset)) return;
+				if (!native_reader::leb128_fits(p, r.info_at(u.end_offset))) return;
+				Dwarf_Unsigned code;
+				attrs = native_reader::read_uleb128(p, code);
+				if (code != 0) p_abbrev = u.p_abbrevs->find(code);
+			}
+
+			explicit operator bool() const { return p_abbrev != nullptr; }
+			bool has_children() const { return p_abbrev->has_children; }
+			/* Where the next DIE (or null entry) in the section begins. */
+			const unsigned char *end() const
+			{ return p_reader->skip_values(*p_unit, *p_abbrev, attrs); }
+			native_die first_child() const;
+			native_die next_sibling() const;
+
+			int find_attr(Dwarf_Half attr) const
+			{
+				for (unsigned i = 0; i < p_abbrev->attrs.size(); ++i)
+				{
+					if (p_abbrev->attrs[i] == attr) return i;
+				}
+				return -1;
+			}
+			bool get_value(Dwarf_Half attr, native_value& out) const;
+			/* Attribute i's value, as copy_attrs() would give it. */
+			encap::attribute_value get_attr_value(unsigned i, root_die& r) const;
+			/* The name, straight out of the string section; null if there's
+			 * no name or we couldn't find it. */
+			const char *get_raw_name() const;
+
+			// abstract_die
+			Dwarf_Off get_offset() const { return off; }
+			Dwarf_Half get_tag() const { return p_abbrev->tag; }
+			opt<string> get_name() const
+			{
+				const char *n = get_raw_name();
+				return n ? opt<string>(string(n)) : opt<string>();
+			}
+			Dwarf_Off get_enclosing_cu_offset() const { return p_unit->die_offset; }
+			bool has_attr(Dwarf_Half attr) const { return find_attr(attr) != -1; }
+			encap::attribute_map copy_attrs(opt<root_die&> opt_r) const;
+			// like Die::spec_here(), for now
+			spec& get_spec(root_die& r) const { return ::dwarf::spec::dwarf3; }
+		};
+
+		/* A DIE's attributes, without copying them: this lists them in 
+		 * abbreviation order, and decodes a value only when it's asked for,
+		 * unlike copy_attrs(), which decodes them all (loclists and all).
+		 * It doesn't own anything, so it's good for as long as the iterator
+		 * or payload it came from. Where the native reader can see the DIE,
+		 * nothing here calls libdwarf except to decode the values that
+		 * copy_attrs() would ask it for. Otherwise we ask libdwarf for just
+		 * the attribute we want (only iterating needs the whole list), and
+		 * in-memory DIEs just look in their map. */
+		struct attribute_view
+		{
+			struct const_iterator
+			{
+				const attribute_view *p_view;
+				Dwarf_Half m_attr; // 0 at the end
+				unsigned idx;      // NOT_LISTED if we came from find() over libdwarf
+				static const unsigned NOT_LISTED = (unsigned) -1;
+
+				Dwarf_Half attr() const { return m_attr; }
+				Dwarf_Half operator*() const { return m_attr; }
+				encap::attribute_value value() const
+				{ return (idx == NOT_LISTED) ? p_view->get(m_attr) : p_view->value_at(idx); }
+				const_iterator& operator++();
+				/* A DIE has at most one of each attribute, so that's 
+				 * enough to tell positions apart. */
+				bool operator==(const const_iterator& arg) const
+				{ return p_view == arg.p_view && m_attr == arg.m_attr; }
+				bool operator!=(const const_iterator& arg) const { return !(*this == arg); }
+			};
+
+			attribute_view(const iterator_base& i, root_die& r);
+			attribute_view(const basic_die& d, root_die& r);
+			attribute_view(const native_die& d, root_die& r);
+
+			unsigned size() const;
+			Dwarf_Half attr_at(unsigned idx) const;
+			encap::attribute_value value_at(unsigned idx) const;
+			const_iterator begin() const;
+			const_iterator end() const { return const_iterator { this, 0, 0 }; }
+			const_iterator find(Dwarf_Half attr) const;
+			bool has(Dwarf_Half attr) const;
+			/* A NO_ATTR value if we don't have it. */
+			encap::attribute_value get(Dwarf_Half attr) const;
+
+		private:
+			root_die *p_root;
+			native_die native;              // if the native reader can see us; else...
+			const Die *p_d;                 // ... if we're libdwarf-backed
+			std::recursive_mutex *p_lock;   // what to hold while using *p_d, if anything
+			const encap::attribute_map *p_in_memory; // ... or if we're not
+			mutable vector<Dwarf_Half> listed; // *p_d's attributes, once somebody iterates
+			mutable bool have_listed;
+
+			void init_from_handle(const Die& d);
+			const vector<Dwarf_Half>& libdwarf_attrs() const;
+		};
+
+		/* What root_die::visit() shows its callbacks: just the things that
+		 * cost nothing to know, plus ways to ask for more. It comes from
+		 * the native reader if that can see the whole file, and otherwise
+		 * from an iterator; either way it's only good during the call. */
+		struct visited_die
+		{
+			root_die& r;
+			Dwarf_Off offset;
+			Dwarf_Half tag;
+			unsigned depth;
+			const native_die *p_native; // if we're reading natively; else...
+			const iterator_base *p_it;  // ... the (handle-only) iterator
+
+			attribute_view attrs() const
+			{ return p_native ? attribute_view(*p_native, r) : attribute_view(*p_it, r); }
+			opt<string_view> name() const
+			{
+				if (!p_native) return p_it->name_view_here();
+				const char *n = p_native->get_raw_name();
+				if (n) return string_view(n);
+				/* A name we couldn't find ourselves (an index we couldn't
+				 * resolve) has to come from libdwarf. */
+				return p_native->has_attr(DW_AT_name) ? r.name_view(iterator()) : opt<string_view>();
+			}
+			/* An iterator, for anything else. Making one may cost a libdwarf
+			 * call, so only ask if you need it. */
+			iterator_base iterator() const
+			{ return p_it ? *p_it : r.pos(offset, depth); }
+		};
+
+		/* Depth-first over every unit in the file. In the section, DIEs are
+		 * already in depth-first order, with a null entry closing each list
+		 * of children, so this is a linear scan. */
+		struct native_iterator_df
+		{
+			native_die cur;
+			unsigned short m_depth; // as for iterator_base, i.e. CUs are 1
+
+			native_iterator_df() : m_depth(0) {}
+			native_iterator_df(const native_die& d, unsigned depth) : cur(d), m_depth(depth) {}
+			static native_iterator_df begin(const native_reader& r);
+
+			unsigned depth() const { return m_depth; }
+			bool is_end() const { return !cur; }
+			const native_die& operator*() const { return cur; }
+			const native_die *operator->() const { return &cur; }
+			native_iterator_df& operator++();
+			/* Like operator++, but not into cur's children; DW_AT_sibling
+			 * (if cur has it) lets us hop straight over them. */
+			native_iterator_df& increment_skipping_subtree();
+		private:
+			/* Carry on from p, which is at the given depth: pop any null
+			 * entries, moving on to the next unit if this one is done. */
+			native_iterator_df& advance_to(const unsigned char *p, unsigned depth);
+		};
+	}
+}
+
+#endif
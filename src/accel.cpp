@@ -0,0 +1,229 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * accel.cpp: name lookup via the accelerator tables that compilers and
+ * linkers leave in the file (.gdb_index, .debug_pubnames, .debug_pubtypes)
+ *
+ * Copyright (c) 2014, Stephen Kell.
+ */
+
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <gelf.h>
+
+#include "lib.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		using std::string;
+		using std::vector;
+		using std::make_pair;
+		using std::set;
+
+		/* The .gdb_index format is documented in the gdb manual ("Index
+		 * Section Format"). Everything in it is little-endian, whatever the
+		 * target. We understand versions 7 and 8, which are what any gdb
+		 * from the last few years will produce; older ones either lack the
+		 * symbol attributes or have a different hash function. */
+		namespace
+		{
+			inline uint32_t le32(const unsigned char *p)
+			{
+				return (uint32_t) p[0]
+					| ((uint32_t) p[1] << 8)
+					| ((uint32_t) p[2] << 16)
+					| ((uint32_t) p[3] << 24);
+			}
+			inline uint64_t le64(const unsigned char *p)
+			{ return (uint64_t) le32(p) | ((uint64_t) le32(p + 4) << 32); }
+
+			/* gdb's mapped_index_string_hash, for index version >= 5. */
+			uint32_t gdb_index_hash(const char *s)
+			{
+				uint32_t r = 0;
+				for (const unsigned char *p = (const unsigned char *) s; *p; ++p)
+				{
+					r = r * 67 + tolower(*p) - 113;
+				}
+				return r;
+			}
+
+			enum { GDB_INDEX_HEADER_WORDS = 6 };
+			enum { GDB_INDEX_CU_INDEX_MASK = 0x00ffffffu };
+		}
+
+		void root_die::init_accelerator()
+		{
+			if (accel_kind != ACCEL_UNKNOWN) return;
+			accel_kind = ACCEL_NONE;
+
+			/* Prefer .gdb_index: unlike pubnames, it covers static symbols
+			 * and types too, so a miss there really is a miss. */
+			::Elf *e = get_elf();
+			size_t shstrndx;
+			if (e && elf_getshdrstrndx(e, &shstrndx) == 0)
+			{
+				for (Elf_Scn *scn = elf_nextscn(e, nullptr); scn; scn = elf_nextscn(e, scn))
+				{
+					GElf_Shdr shdr;
+					if (!gelf_getshdr(scn, &shdr)) continue;
+					const char *name = elf_strptr(e, shstrndx, shdr.sh_name);
+					if (!name || 0 != strcmp(name, ".gdb_index")) continue;
+					Elf_Data *data = elf_getdata(scn, nullptr);
+					if (!data || !data->d_buf
+						|| data->d_size < GDB_INDEX_HEADER_WORDS * 4) break;
+					const unsigned char *p = (const unsigned char *) data->d_buf;
+					uint32_t version = le32(p);
+					if (version < 7 || version > 8) break;
+					/* Sanity-check the offsets, so that lookups needn't. */
+					uint32_t last = 0;
+					bool ok = true;
+					for (unsigned i = 1; i < GDB_INDEX_HEADER_WORDS; ++i)
+					{
+						uint32_t off = le32(p + 4 * i);
+						if (off < last || off > data->d_size) ok = false;
+						last = off;
+					}
+					uint32_t nslots = (le32(p + 20) - le32(p + 16)) / 8;
+					if (!ok || nslots == 0 || (nslots & (nslots - 1)) != 0) break;
+					gdb_index_data = p;
+					gdb_index_len = data->d_size;
+					accel_kind = ACCEL_GDB_INDEX;
+					return;
+				}
+			}
+
+			/* Otherwise try pubnames and pubtypes. libdwarf can read these,
+			 * but they're small enough that we just slurp them into a hash
+			 * table. Errors here just mean we don't get accelerated. */
+			try
+			{
+				Dwarf_Global *globals;
+				Dwarf_Signed nglobals;
+				if (dwarf_get_globals(dbg.raw_handle(), &globals, &nglobals,
+					&current_dwarf_error) == DW_DLV_OK)
+				{
+					for (Dwarf_Signed i = 0; i < nglobals; ++i)
+					{
+						char *name;
+						Dwarf_Off die_off, cu_off;
+						if (dwarf_global_name_offsets(globals[i], &name, &die_off, &cu_off,
+							&current_dwarf_error) != DW_DLV_OK) continue;
+						pubnames_dies.insert(make_pair(string(name), die_off));
+						dwarf_dealloc(dbg.raw_handle(), name, DW_DLA_STRING);
+					}
+					dwarf_globals_dealloc(dbg.raw_handle(), globals, nglobals);
+					accel_kind = ACCEL_PUBNAMES;
+				}
+				Dwarf_Type *types;
+				Dwarf_Signed ntypes;
+				if (dwarf_get_pubtypes(dbg.raw_handle(), &types, &ntypes,
+					&current_dwarf_error) == DW_DLV_OK)
+				{
+					for (Dwarf_Signed i = 0; i < ntypes; ++i)
+					{
+						char *name;
+						Dwarf_Off die_off, cu_off;
+						if (dwarf_pubtype_name_offsets(types[i], &name, &die_off, &cu_off,
+							&current_dwarf_error) != DW_DLV_OK) continue;
+						pubnames_dies.insert(make_pair(string(name), die_off));
+						dwarf_dealloc(dbg.raw_handle(), name, DW_DLA_STRING);
+					}
+					dwarf_pubtypes_dealloc(dbg.raw_handle(), types, ntypes);
+					accel_kind = ACCEL_PUBNAMES;
+				}
+			}
+			catch (Error e)
+			{
+				/* Give up on whatever we half-read. */
+				pubnames_dies.clear();
+				accel_kind = ACCEL_NONE;
+			}
+		}
+
+		bool root_die::accelerated_grandchildren_named(const string& name, vector<Dwarf_Off>& out)
+		{
+			init_accelerator();
+			switch (accel_kind)
+			{
+				case ACCEL_GDB_INDEX: {
+					/* The index only tells us which CUs define the name, so we
+					 * look among each one's children. A CU can have more than
+					 * one child of the same name (a struct and a typedef of it,
+					 * say), so we want all of them, not just the first. */
+					const unsigned char *p = gdb_index_data;
+					const unsigned char *cu_list = p + le32(p + 4);
+					uint32_t ncus = (le32(p + 8) - le32(p + 4)) / 16;
+					const unsigned char *symtab = p + le32(p + 16);
+					uint32_t nslots = (le32(p + 20) - le32(p + 16)) / 8;
+					const unsigned char *pool = p + le32(p + 20);
+					size_t pool_len = gdb_index_len - le32(p + 20);
+
+					uint32_t hash = gdb_index_hash(name.c_str());
+					uint32_t idx = hash & (nslots - 1);
+					uint32_t step = ((hash * 17) & (nslots - 1)) | 1;
+					for (uint32_t probes = 0; probes < nslots; ++probes, idx = (idx + step) & (nslots - 1))
+					{
+						uint32_t name_off = le32(symtab + 8 * idx);
+						uint32_t vec_off = le32(symtab + 8 * idx + 4);
+						if (name_off == 0 && vec_off == 0) break; // empty slot: not there
+						if (name_off >= pool_len || vec_off + 4 > pool_len) break;
+						const char *slot_name = (const char *) pool + name_off;
+						if (0 != strncmp(slot_name, name.c_str(), pool_len - name_off)) continue;
+
+						uint32_t nentries = le32(pool + vec_off);
+						if (vec_off + 4 + 4 * (size_t) nentries > pool_len) break;
+						set<Dwarf_Off> seen_cus;
+						for (uint32_t i = 0; i < nentries; ++i)
+						{
+							uint32_t cu_idx = le32(pool + vec_off + 4 + 4 * i) & GDB_INDEX_CU_INDEX_MASK;
+							if (cu_idx >= ncus) continue; // a type unit; we don't do those
+							Dwarf_Off hdr_off = le64(cu_list + 16 * cu_idx);
+							if (!seen_cus.insert(hdr_off).second) continue;
+							Dwarf_Off cu_die_off;
+							if (dwarf_get_cu_die_offset_given_cu_header_offset(dbg_for_this_thread(),
+								hdr_off, &cu_die_off, &current_dwarf_error) != DW_DLV_OK) continue;
+							/* The CU's named-children table has them all, in
+							 * order, and is built once per CU however many 
+							 * names we look up. If the CU has in-memory 
+							 * children, there's no table, so scan. */
+							iterator_base cu = pos(cu_die_off, 1);
+							const named_children_table *p_table = named_children_of(cu_die_off, &cu);
+							if (p_table)
+							{
+								auto found = p_table->find(name);
+								if (found != p_table->end()) out.insert(out.end(),
+									found->second.begin(), found->second.end());
+								continue;
+							}
+							auto children = cu.children_here();
+							for (auto i_child = std::move(children.first); 
+								i_child != children.second; ++i_child)
+							{
+								auto child_name = i_child.name_view_here();
+								if (child_name && *child_name == name) out.push_back(i_child.offset_here());
+							}
+						}
+						break;
+					}
+					return true;
+				}
+				case ACCEL_PUBNAMES: {
+					auto matching = pubnames_dies.equal_range(name);
+					for (auto i = matching.first; i != matching.second; ++i)
+					{
+						out.push_back(i->second);
+					}
+					/* pubnames only lists external definitions, so whatever it
+					 * has, there may still be statics or types of that name
+					 * in other CUs. The caller has to scan as well. */
+					return false;
+				}
+				default:
+					return false;
+			}
+		}
+	}
+}
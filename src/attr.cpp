@@ -294,7 +294,8 @@ namespace dwarf
 			int cls = spec::interp::EOL; // dummy initialization
 			
 			// find our dwarf spec
-			Dwarf_Off cu_offset = d.enclosing_cu_offset_here();
+			const core::cu_header_info *p_h = r.cu_header_containing(d.offset_here());
+			Dwarf_Off cu_offset = p_h ? p_h->cu_offset : d.enclosing_cu_offset_here();
 			dwarf::spec::abstract_def& spec = r.cu_pos(cu_offset).spec_here();
 
 			if (retval != DW_DLV_OK) goto fail; // retval set by whatform() above
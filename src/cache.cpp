@@ -0,0 +1,187 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * cache.cpp: allocation and bounded caching of DIE payloads
+ *
+ * Copyright (c) 2014, Stephen Kell.
+ */
+
+#include <new>
+#include <malloc.h> /* for malloc_usable_size */
+#include "lib.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		const size_t payload_allocator::HEADER_SIZE;
+		const size_t payload_allocator::GRANULE;
+		const unsigned payload_allocator::NCLASSES;
+		const size_t payload_allocator::SLAB_SIZE;
+		const unsigned payload_allocator::BIG;
+		
+		void *payload_allocator::allocate(size_t sz)
+		{
+			size_t block_size = HEADER_SIZE + sz;
+			unsigned size_class = (block_size + GRANULE - 1) / GRANULE - 1;
+			void *block;
+			std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+			if (shared) guard.lock();
+			if (size_class >= NCLASSES)
+			{
+				block = ::operator new(block_size);
+				size_class = BIG;
+			}
+			else
+			{
+				if (!free_lists[size_class])
+				{
+					/* Carve a fresh slab into blocks of this class. */
+					size_t class_size = (size_class + 1) * GRANULE;
+					char *slab = static_cast<char *>(::operator new(SLAB_SIZE));
+					slabs.push_back(slab);
+					cur_counters.slab_bytes += SLAB_SIZE;
+					for (char *pos = slab; pos + class_size <= slab + SLAB_SIZE; pos += class_size)
+					{
+						*reinterpret_cast<void **>(pos) = free_lists[size_class];
+						free_lists[size_class] = pos;
+					}
+				}
+				block = free_lists[size_class];
+				free_lists[size_class] = *reinterpret_cast<void **>(block);
+			}
+			block_header *h = static_cast<block_header *>(block);
+			h->owner = this;
+			h->size_class = size_class;
+			++cur_counters.allocated;
+			return static_cast<char *>(block) + HEADER_SIZE;
+		}
+		
+		void *payload_allocator::allocate_unowned(size_t sz)
+		{
+			void *block = ::operator new(HEADER_SIZE + sz);
+			block_header *h = static_cast<block_header *>(block);
+			h->owner = nullptr;
+			h->size_class = BIG;
+			return static_cast<char *>(block) + HEADER_SIZE;
+		}
+		
+		void payload_allocator::deallocate(void *obj)
+		{
+			if (!obj) return;
+			void *block = static_cast<char *>(obj) - HEADER_SIZE;
+			block_header *h = static_cast<block_header *>(block);
+			if (!h->owner) { ::operator delete(block); return; }
+			payload_allocator& a = *h->owner;
+			std::unique_lock<std::mutex> guard(a.lock, std::defer_lock);
+			if (a.shared) guard.lock();
+			++a.cur_counters.freed;
+			if (h->size_class == BIG) { ::operator delete(block); return; }
+			*reinterpret_cast<void **>(block) = a.free_lists[h->size_class];
+			a.free_lists[h->size_class] = block;
+		}
+		
+		size_t payload_allocator::allocation_size(void *obj)
+		{
+			block_header *h = reinterpret_cast<block_header *>(static_cast<char *>(obj) - HEADER_SIZE);
+			/* The global heap knows how big its blocks are. */
+			if (h->size_class == BIG) return malloc_usable_size(h) - HEADER_SIZE;
+			return (h->size_class + 1) * GRANULE - HEADER_SIZE;
+		}
+		
+		payload_allocator::~payload_allocator()
+		{
+			/* Bulk release. Anything still allocated from a slab is gone; 
+			 * big blocks were freed individually, as their payloads died. */
+			for (auto i_s = slabs.begin(); i_s != slabs.end(); ++i_s) ::operator delete(*i_s);
+		}
+		
+		lru_payload_cache::ptr_type lru_payload_cache::get(Dwarf_Off off)
+		{
+			auto found = by_offset.find(off);
+			if (found == by_offset.end()) return ptr_type();
+			// move to the front
+			entries.splice(entries.begin(), entries, found->second);
+			return found->second->p;
+		}
+
+		void lru_payload_cache::put(Dwarf_Off off, const ptr_type& p, size_t cost)
+		{
+			erase(off);
+			if (cost > budget) return;
+			while (used + cost > budget)
+			{
+				assert(!entries.empty());
+				used -= entries.back().cost;
+				by_offset.erase(entries.back().off);
+				entries.pop_back();
+			}
+			entries.push_front(entry { off, p, cost });
+			by_offset[off] = entries.begin();
+			used += cost;
+		}
+
+		void lru_payload_cache::erase(Dwarf_Off off)
+		{
+			auto found = by_offset.find(off);
+			if (found == by_offset.end()) return;
+			used -= found->second->cost;
+			entries.erase(found->second);
+			by_offset.erase(found);
+		}
+
+		clock_payload_cache::ptr_type clock_payload_cache::get(Dwarf_Off off)
+		{
+			auto found = by_offset.find(off);
+			if (found == by_offset.end()) return ptr_type();
+			slot& s = slots[found->second];
+			s.referenced = true;
+			return s.p;
+		}
+
+		void clock_payload_cache::evict(unsigned i)
+		{
+			slot& s = slots[i];
+			assert(s.p);
+			used -= s.cost;
+			by_offset.erase(s.off);
+			s.p = ptr_type();
+			s.cost = 0;
+			free_slots.push_back(i);
+		}
+
+		void clock_payload_cache::put(Dwarf_Off off, const ptr_type& p, size_t cost)
+		{
+			erase(off);
+			if (cost > budget) return;
+			/* Sweep the hand round, giving referenced entries a second chance.
+			 * Two full turns are always enough: the first clears every bit. */
+			while (used + cost > budget)
+			{
+				assert(!slots.empty());
+				if (hand >= slots.size()) hand = 0;
+				slot& s = slots[hand];
+				if (s.p)
+				{
+					if (s.referenced) s.referenced = false;
+					else evict(hand);
+				}
+				++hand;
+			}
+			unsigned i;
+			if (!free_slots.empty()) { i = free_slots.back(); free_slots.pop_back(); }
+			else { i = slots.size(); slots.push_back(slot()); }
+			/* New entries start unreferenced, so a one-off scan can't push out
+			 * things that are actually being reused. */
+			slots[i] = slot { off, p, cost, false };
+			by_offset[off] = i;
+			used += cost;
+		}
+
+		void clock_payload_cache::erase(Dwarf_Off off)
+		{
+			auto found = by_offset.find(off);
+			if (found == by_offset.end()) return;
+			evict(found->second);
+		}
+	}
+}
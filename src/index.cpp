@@ -0,0 +1,449 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * index.cpp: persistent (mmap-able) index files for root_die
+ *
+ * Copyright (c) 2014, Stephen Kell.
+ */
+
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gelf.h>
+
+#include "lib.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		using std::string;
+		using std::vector;
+		using std::pair;
+		using std::make_pair;
+		using std::cerr;
+		using std::endl;
+
+		/* The index file format. Everything is in host byte order, since an
+		 * index is a cache for one machine's use; we check a byte-order mark
+		 * to be sure. All "_pos" fields are byte offsets from the start of the
+		 * file, so the file can be mapped anywhere. Every table starts on an
+		 * 8-byte boundary.
+		 *
+		 * Bump INDEX_VERSION whenever any of this changes. */
+		namespace
+		{
+			const char INDEX_MAGIC[8] = { 'D', 'W', 'P', 'P', 'I', 'D', 'X', '\0' };
+			const uint32_t INDEX_VERSION = 1;
+			const uint32_t INDEX_BYTE_ORDER_MARK = 0x01020304;
+			const unsigned MAX_BUILD_ID_LEN = 64;
+
+			struct index_header
+			{
+				char magic[8];
+				uint32_t version;
+				uint32_t byte_order_mark;
+				uint32_t build_id_len;
+				uint32_t padding;
+				unsigned char build_id[MAX_BUILD_ID_LEN];
+				uint64_t file_len;
+
+				uint64_t ncus;    uint64_t cus_pos;
+				uint64_t ndies;   uint64_t die_offsets_pos, die_parents_pos,
+				                  die_first_children_pos, die_next_siblings_pos,
+				                  die_depths_pos, die_tags_pos;
+				uint64_t nnames;  uint64_t names_pos;
+				uint64_t strings_len; uint64_t strings_pos;
+				uint64_t nranges; uint64_t ranges_pos;
+			};
+			struct index_cu
+			{
+				uint64_t cu_offset;
+				uint64_t end_offset;
+				uint64_t first_die; // index into the die_* tables
+				uint64_t ndies;
+			};
+			struct index_name
+			{
+				uint64_t die_offset;
+				uint32_t name_pos; // into the string table
+				uint32_t name_len;
+			};
+
+			/* Helper for building up the file image. */
+			struct image
+			{
+				vector<char> bytes;
+				uint64_t align()
+				{
+					while (bytes.size() % 8 != 0) bytes.push_back('\0');
+					return bytes.size();
+				}
+				template <typename T>
+				uint64_t append(const T *p, size_t n)
+				{
+					uint64_t pos = align();
+					const char *begin = reinterpret_cast<const char *>(p);
+					bytes.insert(bytes.end(), begin, begin + n * sizeof (T));
+					return pos;
+				}
+			};
+
+			template <typename T>
+			const T *table_at(const char *base, uint64_t pos)
+			{ return reinterpret_cast<const T *>(base + pos); }
+
+			/* Does a table of n Ts at pos lie within the file (and on the 
+			 * boundary we promise)? Careful not to overflow. */
+			template <typename T>
+			bool table_fits(const index_header& h, uint64_t pos, uint64_t n)
+			{
+				return pos % 8 == 0 && pos >= sizeof (index_header) && pos <= h.file_len
+					&& n <= (h.file_len - pos) / sizeof (T);
+			}
+
+			bool ordinal_ok(cu_topology::ordinal_t o, uint64_t ndies)
+			{ return o == cu_topology::NONE || o < ndies; }
+
+			/* The header matched, but the file may still be truncated or 
+			 * scribbled on; check every table and every range into one 
+			 * before we trust any of them. */
+			bool index_is_sane(const char *base, const index_header& h)
+			{
+				if (!table_fits<index_cu>(h, h.cus_pos, h.ncus)
+					|| !table_fits<Dwarf_Off>(h, h.die_offsets_pos, h.ndies)
+					|| !table_fits<cu_topology::ordinal_t>(h, h.die_parents_pos, h.ndies)
+					|| !table_fits<cu_topology::ordinal_t>(h, h.die_first_children_pos, h.ndies)
+					|| !table_fits<cu_topology::ordinal_t>(h, h.die_next_siblings_pos, h.ndies)
+					|| !table_fits<unsigned short>(h, h.die_depths_pos, h.ndies)
+					|| !table_fits<Dwarf_Half>(h, h.die_tags_pos, h.ndies)
+					|| !table_fits<index_name>(h, h.names_pos, h.nnames)
+					|| !table_fits<char>(h, h.strings_pos, h.strings_len)
+					|| !table_fits<cu_address_range>(h, h.ranges_pos, h.nranges))
+				{
+					return false;
+				}
+
+				/* Each CU's run of DIEs, their offsets (the CU's own first,
+				 * then ascending, all within the CU) and the ordinals. */
+				const index_cu *cus = table_at<index_cu>(base, h.cus_pos);
+				const Dwarf_Off *offsets = table_at<Dwarf_Off>(base, h.die_offsets_pos);
+				const unsigned short *depths = table_at<unsigned short>(base, h.die_depths_pos);
+				const cu_topology::ordinal_t *parents = table_at<cu_topology::ordinal_t>(base, h.die_parents_pos);
+				const cu_topology::ordinal_t *first_children = table_at<cu_topology::ordinal_t>(base, h.die_first_children_pos);
+				const cu_topology::ordinal_t *next_siblings = table_at<cu_topology::ordinal_t>(base, h.die_next_siblings_pos);
+				for (uint64_t i = 0; i < h.ncus; ++i)
+				{
+					const index_cu& c = cus[i];
+					if (c.first_die > h.ndies || c.ndies > h.ndies - c.first_die) return false;
+					if (c.ndies >= cu_topology::NONE) return false;
+					if (c.ndies == 0 || c.cu_offset >= c.end_offset 
+						|| offsets[c.first_die] != c.cu_offset) return false;
+					for (uint64_t o = c.first_die; o < c.first_die + c.ndies; ++o)
+					{
+						if (offsets[o] >= c.end_offset
+							|| (o > c.first_die && offsets[o] <= offsets[o - 1])) return false;
+						if (!ordinal_ok(parents[o], c.ndies)
+							|| !ordinal_ok(first_children[o], c.ndies)
+							|| !ordinal_ok(next_siblings[o], c.ndies))
+						{
+							return false;
+						}
+					}
+				}
+
+				/* The CUs mustn't overlap, so that each offset has at most
+				 * one CU to look in. */
+				vector<const index_cu *> by_offset;
+				for (uint64_t i = 0; i < h.ncus; ++i) by_offset.push_back(&cus[i]);
+				auto offset_less = [](const index_cu *p1, const index_cu *p2) {
+					return p1->cu_offset < p2->cu_offset;
+				};
+				std::sort(by_offset.begin(), by_offset.end(), offset_less);
+				for (unsigned i = 1; i < by_offset.size(); ++i)
+				{
+					if (by_offset[i]->cu_offset < by_offset[i - 1]->end_offset) return false;
+				}
+
+				/* Each name's range of the string table, and its DIE: one of
+				 * its CU's (so inside that CU's range), at depth 2. Otherwise
+				 * pos() would be asked for a DIE that isn't there. */
+				const index_name *names = table_at<index_name>(base, h.names_pos);
+				for (uint64_t i = 0; i < h.nnames; ++i)
+				{
+					if ((uint64_t) names[i].name_pos + names[i].name_len > h.strings_len) return false;
+					Dwarf_Off off = names[i].die_offset;
+					index_cu key; key.cu_offset = off;
+					auto found_cu = std::upper_bound(by_offset.begin(), by_offset.end(), &key, offset_less);
+					if (found_cu == by_offset.begin()) return false;
+					const index_cu& c = **(found_cu - 1);
+					if (off >= c.end_offset) return false;
+					const Dwarf_Off *found = std::lower_bound(offsets + c.first_die,
+						offsets + c.first_die + c.ndies, off);
+					if (found == offsets + c.first_die + c.ndies || *found != off
+						|| depths[found - offsets] != 2) return false;
+				}
+				return true;
+			}
+		}
+
+		vector<unsigned char> root_die::build_id()
+		{
+			::Elf *e = get_elf();
+			if (!e) return vector<unsigned char>();
+			for (Elf_Scn *scn = elf_nextscn(e, nullptr); scn; scn = elf_nextscn(e, scn))
+			{
+				GElf_Shdr shdr;
+				if (!gelf_getshdr(scn, &shdr) || shdr.sh_type != SHT_NOTE) continue;
+				Elf_Data *data = elf_getdata(scn, nullptr);
+				if (!data) continue;
+				size_t off = 0, name_off, desc_off;
+				GElf_Nhdr nhdr;
+				while ((off = gelf_getnote(data, off, &nhdr, &name_off, &desc_off)) > 0)
+				{
+					const char *buf = static_cast<const char *>(data->d_buf);
+					if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4
+						&& 0 == memcmp(buf + name_off, "GNU", 4))
+					{
+						return vector<unsigned char>(
+							reinterpret_cast<const unsigned char *>(buf + desc_off),
+							reinterpret_cast<const unsigned char *>(buf + desc_off + nhdr.n_descsz)
+						);
+					}
+				}
+			}
+			return vector<unsigned char>();
+		}
+
+		void root_die::ensure_cu_address_ranges()
+		{
+			if (have_cu_ranges) return;
+
+			/* Ask each CU for its intervals. */
+			cu_ranges_storage.clear();
+			auto cus = children();
+			for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+			{
+				auto intervals = i_cu->file_relative_intervals(*this, nullptr, nullptr);
+				for (auto i_int = intervals.begin(); i_int != intervals.end(); ++i_int)
+				{
+					cu_ranges_storage.push_back(cu_address_range {
+						i_int->first.lower(), i_int->first.upper(),
+						i_cu.base().base().offset_here()
+					});
+				}
+			}
+			std::sort(cu_ranges_storage.begin(), cu_ranges_storage.end());
+			cu_ranges_begin = cu_ranges_storage.data();
+			cu_ranges_end = cu_ranges_storage.data() + cu_ranges_storage.size();
+			have_cu_ranges = true;
+		}
+
+		iterator_df<compile_unit_die>
+		root_die::cu_for_addr(Dwarf_Addr file_relative_addr)
+		{
+			ensure_cu_address_ranges();
+			/* Find the last range beginning at or before the address. */
+			cu_address_range key = { file_relative_addr, 0, 0 };
+			auto found = std::upper_bound(cu_ranges_begin, cu_ranges_end, key);
+			if (found == cu_ranges_begin) return iterator_base::END;
+			--found;
+			if (file_relative_addr >= found->end) return iterator_base::END;
+			return cu_pos(found->cu_offset);
+		}
+
+		bool root_die::write_index(const string& path, unsigned nthreads)
+		{
+			vector<unsigned char> id = build_id();
+			if (id.size() == 0 || id.size() > MAX_BUILD_ID_LEN) return false;
+
+			/* Make sure we have everything we're going to write. */
+			build_index(nthreads);
+			ensure_cu_address_ranges();
+
+			index_header h;
+			memset(&h, 0, sizeof h);
+			memcpy(h.magic, INDEX_MAGIC, sizeof h.magic);
+			h.version = INDEX_VERSION;
+			h.byte_order_mark = INDEX_BYTE_ORDER_MARK;
+			h.build_id_len = id.size();
+			memcpy(h.build_id, &id[0], id.size());
+
+			/* Flatten the topologies into tables, CU by CU. Ordinals are
+			 * CU-relative, so they need no adjustment. */
+			vector<index_cu> cus;
+			vector<Dwarf_Off> offsets;
+			vector<cu_topology::ordinal_t> parents, first_children, next_siblings;
+			vector<unsigned short> depths;
+			vector<Dwarf_Half> tags;
+			for (auto i_t = cu_topologies.begin(); i_t != cu_topologies.end(); ++i_t)
+			{
+				const cu_topology& t = i_t->second;
+				cus.push_back(index_cu { t.cu_offset, t.end_offset, offsets.size(), t.size() });
+				offsets.insert(offsets.end(), t.offsets.begin(), t.offsets.end());
+				parents.insert(parents.end(), t.parent.begin(), t.parent.end());
+				first_children.insert(first_children.end(), t.first_child.begin(), t.first_child.end());
+				next_siblings.insert(next_siblings.end(), t.next_sibling.begin(), t.next_sibling.end());
+				depths.insert(depths.end(), t.depth.begin(), t.depth.end());
+				tags.insert(tags.end(), t.tag.begin(), t.tag.end());
+			}
+
+			/* Named grandchildren, sorted by name. Like
+			 * resolve_all_visible_from_root(), we record them all,
+			 * and leave visibility to the lookup. */
+			vector< pair<string, Dwarf_Off> > named;
+			for (auto i_t = cu_topologies.begin(); i_t != cu_topologies.end(); ++i_t)
+			{
+				const cu_topology& t = i_t->second;
+				for (cu_topology::ordinal_t o = 0; o < t.size(); ++o)
+				{
+					if (t.depth_of(o) != 2) continue;
+					auto name = pos(t.offsets[o], 2).name_here();
+					if (name) named.push_back(make_pair(*name, t.offsets[o]));
+				}
+			}
+			std::sort(named.begin(), named.end());
+			string strings;
+			vector<index_name> names;
+			for (auto i_n = named.begin(); i_n != named.end(); ++i_n)
+			{
+				names.push_back(index_name { i_n->second,
+					(uint32_t) strings.size(), (uint32_t) i_n->first.size() });
+				strings += i_n->first;
+			}
+
+			/* Lay out the image. The header goes first; we fill it in last. */
+			image img;
+			img.append(&h, 1);
+			h.ncus = cus.size();              h.cus_pos = img.append(cus.data(), cus.size());
+			h.ndies = offsets.size();
+			h.die_offsets_pos = img.append(offsets.data(), offsets.size());
+			h.die_parents_pos = img.append(parents.data(), parents.size());
+			h.die_first_children_pos = img.append(first_children.data(), first_children.size());
+			h.die_next_siblings_pos = img.append(next_siblings.data(), next_siblings.size());
+			h.die_depths_pos = img.append(depths.data(), depths.size());
+			h.die_tags_pos = img.append(tags.data(), tags.size());
+			h.nnames = names.size();          h.names_pos = img.append(names.data(), names.size());
+			h.strings_len = strings.size();   h.strings_pos = img.append(strings.data(), strings.size());
+			h.nranges = cu_ranges_end - cu_ranges_begin;
+			h.ranges_pos = img.append(cu_ranges_begin, h.nranges);
+			h.file_len = img.align();
+			memcpy(&img.bytes[0], &h, sizeof h);
+
+			/* Write to a temporary, then rename, so that concurrent readers
+			 * never see a partial index. */
+			std::ostringstream tmp_path;
+			tmp_path << path << ".tmp." << getpid();
+			FILE *f = fopen(tmp_path.str().c_str(), "wb");
+			if (!f) return false;
+			bool ok = fwrite(&img.bytes[0], 1, img.bytes.size(), f) == img.bytes.size();
+			ok = (fclose(f) == 0) && ok;
+			if (ok) ok = (rename(tmp_path.str().c_str(), path.c_str()) == 0);
+			if (!ok) unlink(tmp_path.str().c_str());
+			return ok;
+		}
+
+		bool root_die::load_index(const string& path)
+		{
+			if (mapped_index) return true; // only one at a time
+			vector<unsigned char> id = build_id();
+			if (id.size() == 0) return false;
+
+			int index_fd = open(path.c_str(), O_RDONLY);
+			if (index_fd == -1) return false;
+			struct stat st;
+			if (fstat(index_fd, &st) != 0 || (size_t) st.st_size < sizeof (index_header))
+			{ close(index_fd); return false; }
+			void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, index_fd, 0);
+			close(index_fd);
+			if (mapping == MAP_FAILED) return false;
+
+			/* Validate. */
+			const char *base = static_cast<const char *>(mapping);
+			const index_header& h = *table_at<index_header>(base, 0);
+			if (0 != memcmp(h.magic, INDEX_MAGIC, sizeof h.magic)
+				|| h.version != INDEX_VERSION
+				|| h.byte_order_mark != INDEX_BYTE_ORDER_MARK
+				|| h.file_len != (uint64_t) st.st_size
+				|| h.build_id_len != id.size()
+				|| 0 != memcmp(h.build_id, &id[0], id.size())
+				|| !index_is_sane(base, h))
+			{
+				cerr << "Warning: ignoring stale or corrupt index " << path << endl;
+				munmap(mapping, st.st_size);
+				return false;
+			}
+
+			/* Topologies: we copy these out, since the rest of the code
+			 * wants them as vectors. That's a handful of memcpys per CU. */
+			const index_cu *cus = table_at<index_cu>(base, h.cus_pos);
+			const Dwarf_Off *offsets = table_at<Dwarf_Off>(base, h.die_offsets_pos);
+			const cu_topology::ordinal_t *parents = table_at<cu_topology::ordinal_t>(base, h.die_parents_pos);
+			const cu_topology::ordinal_t *first_children = table_at<cu_topology::ordinal_t>(base, h.die_first_children_pos);
+			const cu_topology::ordinal_t *next_siblings = table_at<cu_topology::ordinal_t>(base, h.die_next_siblings_pos);
+			const unsigned short *depths = table_at<unsigned short>(base, h.die_depths_pos);
+			const Dwarf_Half *tags = table_at<Dwarf_Half>(base, h.die_tags_pos);
+			for (uint64_t i = 0; i < h.ncus; ++i)
+			{
+				const index_cu& c = cus[i];
+				if (cu_topologies.find(c.cu_offset) != cu_topologies.end()) continue;
+				cu_topology& t = cu_topologies[c.cu_offset];
+				t.cu_offset = c.cu_offset;
+				t.end_offset = c.end_offset;
+				t.offsets.assign(offsets + c.first_die, offsets + c.first_die + c.ndies);
+				t.parent.assign(parents + c.first_die, parents + c.first_die + c.ndies);
+				t.first_child.assign(first_children + c.first_die, first_children + c.first_die + c.ndies);
+				t.next_sibling.assign(next_siblings + c.first_die, next_siblings + c.first_die + c.ndies);
+				t.depth.assign(depths + c.first_die, depths + c.first_die + c.ndies);
+				t.tag.assign(tags + c.first_die, tags + c.first_die + c.ndies);
+				t.index_children();
+				descent_parents.erase(c.cu_offset);
+			}
+
+			/* Names: the grandchildren cache is now complete. */
+			const index_name *names = table_at<index_name>(base, h.names_pos);
+			const char *strings = table_at<char>(base, h.strings_pos);
+			visible_named_grandchildren.clear();
+			for (uint64_t i = 0; i < h.nnames; ++i)
+			{
+				visible_named_grandchildren.insert(make_pair(
+					string(strings + names[i].name_pos, names[i].name_len),
+					names[i].die_offset
+				));
+			}
+			visible_named_grandchildren_is_complete = true;
+
+			/* Address ranges: these we use in place. */
+			cu_ranges_storage.clear();
+			cu_ranges_begin = table_at<cu_address_range>(base, h.ranges_pos);
+			cu_ranges_end = cu_ranges_begin + h.nranges;
+			have_cu_ranges = true;
+
+			mapped_index = mapping;
+			mapped_index_len = st.st_size;
+			return true;
+		}
+
+		bool root_die::use_index_cache(const string& dir, unsigned nthreads)
+		{
+			vector<unsigned char> id = build_id();
+			if (id.size() == 0) { build_index(nthreads); return false; }
+			std::ostringstream s;
+			s << dir << "/";
+			for (auto i = id.begin(); i != id.end(); ++i)
+			{
+				s << std::hex << std::setw(2) << std::setfill('0') << (unsigned) *i;
+			}
+			s << ".dwarfpp-index";
+
+			if (load_index(s.str())) return true;
+			// write_index() builds the index in passing, so we're warm either way
+			return write_index(s.str(), nthreads);
+		}
+	}
+}
@@ -11,12 +11,18 @@
 	// FIXME: flip the above around, so that the formatting logic is in here!
 #include "dwarfpp/expr.hpp" /* for absolute_loclist_to_additive_loclist */
 #include "dwarfpp/frame.hpp"
+#include "dwarfpp/native.hpp"
 
 #include <srk31/indenting_ostream.hpp>
 #include <srk31/algorithm.hpp>
 #include <sstream>
 #include <libelf.h>
 #include <cstring> /* We use strcmp in linear search-by-name -- likely this will change */ 
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <sys/mman.h>
+#include <limits>
 
 namespace dwarf
 {
@@ -143,6 +149,25 @@ namespace dwarf
 		 * not have to copy. */
 		void root_die::print_tree(iterator_base&& begin, std::ostream& s) const
 		{
+			/* Dumping the whole file is the common case, and the native reader
+			 * does it without a libdwarf call per DIE. It can't see in-memory 
+			 * DIEs, though, and it reads all units, which libdwarf may not. */
+			root_die *nonconst_this = const_cast<root_die *>(this);
+			native_reader *p_native = begin.is_root_position()
+				? nonconst_this->native_reader_for_whole_file() : nullptr;
+			if (p_native)
+			{
+				begin.print_with_attrs(s, 0); // the root
+				for (auto i = native_iterator_df::begin(*p_native); !i.is_end(); ++i)
+				{
+					for (unsigned u = 0; u < i.depth(); ++u) s << "\t";
+					s << "DIE, offset 0x" << std::hex << i->get_offset() << std::dec
+						<< ", tag " << i->get_spec(*nonconst_this).tag_lookup(i->get_tag())
+						<< ", attributes: " << endl;
+					i->copy_attrs(*nonconst_this).print(s, i.depth() + 1);
+				}
+				return;
+			}
 			unsigned start_depth = begin.m_depth;
 			Dwarf_Off start_offset = begin.offset_here();
 			for (iterator_df<> i = std::move(begin);
@@ -193,8 +218,16 @@ namespace dwarf
 		{
 			return copy_attrs(opt_r);
 		}
+		std::unique_lock<std::recursive_mutex> basic_die::shared_guard() const
+		{
+			root_die *p_r = d.handle.get_deleter().p_constructing_root;
+			std::recursive_mutex *p_m = p_r ? p_r->shared_lock_for(d.get_dbg()) : nullptr;
+			if (!p_m) return std::unique_lock<std::recursive_mutex>();
+			return std::unique_lock<std::recursive_mutex>(*p_m);
+		}
 		encap::attribute_value basic_die::attr(Dwarf_Half a, optional_root_arg_decl) const
 		{
+			auto guard = shared_guard();
 			Attribute attr(d, a);
 			return encap::attribute_value(attr, d, get_root(opt_r));
 		}
@@ -276,9 +309,16 @@ namespace dwarf
 		
 		root_die::root_die(int fd)
 		 :  dbg(fd), 
+			concurrent_readers(false), reader_generation(0),
 			visible_named_grandchildren_is_complete(false),
 			p_fs(new FrameSection(get_dbg(), true)), 
-			current_cu_offset(0UL), returned_elf(nullptr), 
+			current_cu_offset(0UL), returned_elf(nullptr), fd(fd),
+			mapped_index(nullptr), mapped_index_len(0), have_cu_ranges(false),
+			cu_ranges_begin(nullptr), cu_ranges_end(nullptr),
+			accel_kind(ACCEL_UNKNOWN), gdb_index_data(nullptr), gdb_index_len(0),
+			have_scope_index(false), have_reverse_refs(false), have_file_reverse_refs(false),
+			have_cu_headers(false),
+			tried_native_reader(false), p_native_reader(nullptr),
 			first_cu_offset(),
 			last_seen_cu_header_length(),
 			last_seen_version_stamp(),
@@ -289,7 +329,39 @@ namespace dwarf
 			last_seen_next_cu_header()
 		{ assert(p_fs != 0); }
 		
-		root_die::~root_die() { delete p_fs; }
+		root_die::~root_die() 
+		{ 
+			delete p_fs; 
+			delete p_native_reader;
+			if (mapped_index) munmap(mapped_index, mapped_index_len);
+		}
+		
+		native_reader *root_die::get_native_reader()
+		{
+			if (!tried_native_reader)
+			{
+				tried_native_reader = true;
+				if (fd != -1 && get_elf())
+				{
+					p_native_reader = new native_reader(fd, get_elf());
+					if (!p_native_reader->usable())
+					{
+						delete p_native_reader;
+						p_native_reader = nullptr;
+					}
+				}
+			}
+			return p_native_reader;
+		}
+		
+		native_reader *root_die::native_reader_for_whole_file()
+		{
+			if (!parent_of.empty()) return nullptr;
+			native_reader *p_native = get_native_reader();
+			if (!p_native) return nullptr;
+			ensure_cu_headers();
+			return (p_native->units().size() == cu_headers.size()) ? p_native : nullptr;
+		}
 		
 		::Elf *root_die::get_elf()
 		{
@@ -306,6 +378,677 @@ namespace dwarf
 			}
 		}
 		
+		const cu_topology::ordinal_t cu_topology::NONE;
+		const unsigned address_scope::NO_PARENT;
+		
+		void cu_topology::build(Dwarf_Debug dbg, Dwarf_Off cu_off)
+		{
+			offsets.clear(); parent.clear(); first_child.clear(); next_sibling.clear();
+			depth.clear(); tag.clear();
+			
+			Dwarf_Die cu_die;
+			int ret = dwarf_offdie(dbg, cu_off, &cu_die, &current_dwarf_error);
+			if (ret != DW_DLV_OK) throw Error(current_dwarf_error, 0);
+			Dwarf_Off cu_header_off;
+			Dwarf_Off cu_length;
+			ret = dwarf_die_CU_offset_range(cu_die, &cu_header_off, &cu_length, &current_dwarf_error);
+			if (ret != DW_DLV_OK) throw Error(current_dwarf_error, 0);
+			cu_offset = cu_off;
+			end_offset = cu_header_off + cu_length;
+			
+			auto offset_of = [](Dwarf_Die d) -> Dwarf_Off {
+				Dwarf_Off off;
+				int ret = dwarf_dieoffset(d, &off, &current_dwarf_error);
+				if (ret != DW_DLV_OK) throw Error(current_dwarf_error, 0);
+				return off;
+			};
+			
+			auto tag_of = [](Dwarf_Die d) -> Dwarf_Half {
+				Dwarf_Half tag;
+				int ret = dwarf_tag(d, &tag, &current_dwarf_error);
+				if (ret != DW_DLV_OK) throw Error(current_dwarf_error, 0);
+				return tag;
+			};
+			
+			/* Iterative depth-first walk. "path" holds the raw handle and 
+			 * ordinal of the current DIE at each depth, starting with the CU. */
+			vector< pair<Dwarf_Die, ordinal_t> > path;
+			path.push_back(make_pair(cu_die, append(cu_off, tag_of(cu_die), NONE)));
+			while (true)
+			{
+				// try to descend
+				Dwarf_Die child;
+				ret = dwarf_child(path.back().first, &child, &current_dwarf_error);
+				if (ret == DW_DLV_ERROR) throw Error(current_dwarf_error, 0);
+				if (ret == DW_DLV_OK)
+				{
+					ordinal_t o = append(offset_of(child), tag_of(child), path.back().second);
+					first_child[path.back().second] = o;
+					path.push_back(make_pair(child, o));
+					continue;
+				}
+				// no children, so move along, moving up as necessary
+				while (path.size() > 1)
+				{
+					Dwarf_Die sib;
+					ret = dwarf_siblingof(dbg, path.back().first, &sib, &current_dwarf_error);
+					if (ret == DW_DLV_ERROR) throw Error(current_dwarf_error, 0);
+					dwarf_dealloc(dbg, path.back().first, DW_DLA_DIE);
+					if (ret == DW_DLV_OK)
+					{
+						ordinal_t o = append(offset_of(sib), tag_of(sib), path[path.size() - 2].second);
+						next_sibling[path.back().second] = o;
+						path.back() = make_pair(sib, o);
+						break;
+					}
+					path.pop_back();
+				}
+				// we don't do CU siblings -- the CU's parent is the root
+				if (path.size() == 1) break;
+			}
+			dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+			index_children();
+		}
+		
+		void cu_topology::index_children()
+		{
+			/* Ordinals are in depth-first order, so each DIE's children 
+			 * come in order if we just visit the ordinals in order. First
+			 * count, then place. */
+			child_begin.assign(size() + 1, 0);
+			for (ordinal_t o = 0; o < size(); ++o)
+			{
+				if (parent[o] != NONE) ++child_begin[parent[o] + 1];
+			}
+			for (ordinal_t o = 0; o < size(); ++o) child_begin[o + 1] += child_begin[o];
+			child_offsets.resize(child_begin[size()]);
+			vector<unsigned> next_slot(child_begin.begin(), child_begin.end() - 1);
+			for (ordinal_t o = 0; o < size(); ++o)
+			{
+				if (parent[o] != NONE) child_offsets[next_slot[parent[o]]++] = offsets[o];
+			}
+		}
+		
+		const cu_topology *root_die::topology_containing(Dwarf_Off off) const
+		{
+			auto found = cu_topologies.upper_bound(off);
+			if (found == cu_topologies.begin()) return nullptr;
+			--found;
+			return found->second.contains(off) ? &found->second : nullptr;
+		}
+		
+		const cu_topology *root_die::topology_for_cu(Dwarf_Off cu_off)
+		{
+			auto found = cu_topologies.find(cu_off);
+			if (found != cu_topologies.end()) return &found->second;
+			if (!dbg.handle) return nullptr;
+			
+			// concurrent readers only find complete topologies
+			assert(!concurrent_readers);
+			cu_topology& t = cu_topologies[cu_off];
+			t.build(dbg.handle.get(), cu_off);
+			descent_parents.erase(cu_off); // the topology knows better
+			return &t;
+		}
+
+		optional<Dwarf_Off> root_die::descent_parent_of(Dwarf_Off off) const
+		{
+			// the last CU starting at or before off is the only one that can know
+			auto found_cu = descent_parents.upper_bound(off);
+			if (found_cu == descent_parents.begin()) return optional<Dwarf_Off>();
+			--found_cu;
+			auto found = found_cu->second.find(off);
+			if (found == found_cu->second.end()) return optional<Dwarf_Off>();
+			return found->second;
+		}
+
+		vector<Dwarf_Off> root_die::descent_path_before(Dwarf_Off cu_off, Dwarf_Off off) const
+		{
+			/* The ancestors (below the CU, outermost first) of the last DIE
+			 * we've stepped over at or before off, and that DIE itself.
+			 * Everything we record has its parent recorded too, unless
+			 * that's the CU, so the chain is unbroken. */
+			vector<Dwarf_Off> path;
+			auto found_cu = descent_parents.find(cu_off);
+			if (found_cu == descent_parents.end()) return path;
+			const map<Dwarf_Off, Dwarf_Off>& edges = found_cu->second;
+			auto found = edges.upper_bound(off);
+			if (found == edges.begin()) return path;
+			--found;
+			path.push_back(found->first);
+			while (found->second != cu_off)
+			{
+				path.push_back(found->second);
+				found = edges.find(found->second);
+				assert(found != edges.end());
+			}
+			std::reverse(path.begin(), path.end());
+			return path;
+		}
+		
+		/* Read all the CU headers, using libdwarf's CU-header walk. This
+		 * runs the walk to its end, leaving dbg with no CU context, so 
+		 * don't call it on a Dwarf_Debug whose context anybody cares about
+		 * (or if dbg is halfway through a walk, finish it first). */
+		static vector<cu_header_info> cu_headers_in(Dwarf_Debug dbg)
+		{
+			vector<cu_header_info> headers;
+			cu_header_info h;
+			while (dwarf_next_cu_header_b(dbg, &h.cu_header_length, &h.version_stamp,
+				&h.abbrev_offset, &h.address_size, &h.offset_size, &h.extension_size,
+				&h.next_cu_header, &current_dwarf_error) == DW_DLV_OK)
+			{
+				Dwarf_Die cu_die;
+				int ret = dwarf_siblingof(dbg, nullptr, &cu_die, &current_dwarf_error);
+				if (ret != DW_DLV_OK) throw Error(current_dwarf_error, 0);
+				ret = dwarf_dieoffset(cu_die, &h.cu_offset, &current_dwarf_error);
+				dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
+				if (ret != DW_DLV_OK) throw Error(current_dwarf_error, 0);
+				headers.push_back(h);
+			}
+			// they come in file order, but let's not rely on that
+			std::sort(headers.begin(), headers.end());
+			/* Each CU ends where the next header starts. If libdwarf told 
+			 * us something odd, settle for the next CU DIE's offset. */
+			for (auto i_h = headers.begin(); i_h != headers.end(); ++i_h)
+			{
+				i_h->cu_end = i_h->next_cu_header;
+				if (i_h->cu_end <= i_h->cu_offset)
+				{
+					i_h->cu_end = (i_h + 1 == headers.end())
+						? std::numeric_limits<Dwarf_Off>::max() : (i_h + 1)->cu_offset;
+				}
+			}
+			return headers;
+		}
+		static vector<Dwarf_Off> cu_offsets_in(Dwarf_Debug dbg)
+		{
+			vector<cu_header_info> headers = cu_headers_in(dbg);
+			vector<Dwarf_Off> cu_offsets;
+			for (auto i_h = headers.begin(); i_h != headers.end(); ++i_h) cu_offsets.push_back(i_h->cu_offset);
+			return cu_offsets;
+		}
+		
+		void root_die::ensure_cu_headers()
+		{
+			if (have_cu_headers) return;
+			assert(!concurrent_readers);
+			if (dbg.handle)
+			{
+				/* Anyone still using the old CU-context API can cope with 
+				 * losing their place; clear_cu_context() is what they'd do 
+				 * anyway. */
+				clear_cu_context();
+				cu_headers = cu_headers_in(dbg.raw_handle());
+			}
+			have_cu_headers = true;
+		}
+		
+		const cu_header_info *root_die::cu_header_for(Dwarf_Off off)
+		{
+			ensure_cu_headers();
+			cu_header_info key; key.cu_offset = off;
+			auto found = std::lower_bound(cu_headers.begin(), cu_headers.end(), key);
+			if (found == cu_headers.end() || found->cu_offset != off) return nullptr;
+			return &*found;
+		}
+		
+		const cu_header_info *root_die::cu_header_containing(Dwarf_Off off)
+		{
+			ensure_cu_headers();
+			cu_header_info key; key.cu_offset = off;
+			auto found = std::upper_bound(cu_headers.begin(), cu_headers.end(), key);
+			if (found == cu_headers.begin()) return nullptr;
+			--found;
+			if (off >= found->cu_end) return nullptr;
+			return &*found;
+		}
+		
+		Dwarf_Off root_die::enclosing_cu_offset_of(const basic_die& d)
+		{
+			if (d.d.handle)
+			{
+				const cu_header_info *p_h = cu_header_containing(d.d.offset_here());
+				if (p_h) return p_h->cu_offset;
+			}
+			return d.get_enclosing_cu_offset();
+		}
+		
+#ifndef NO_TLS
+		/* Each thread remembers the last reader state it used, so that 
+		 * it doesn't have to take readers_lock every time. Roots are told 
+		 * apart by generation number, not address, since a new root_die 
+		 * might reuse a dead one's address. */
+		static std::atomic<unsigned long> next_reader_generation(1);
+		static __thread unsigned long last_reader_generation;
+		static __thread void *last_reader_state;
+#endif
+		
+		root_die::reader_state *root_die::this_reader()
+		{
+			assert(concurrent_readers);
+#ifndef NO_TLS
+			if (last_reader_generation == reader_generation)
+			{
+				return static_cast<reader_state *>(last_reader_state);
+			}
+			std::lock_guard<std::mutex> guard(readers_lock);
+			unique_ptr<reader_state>& p_state = readers[std::this_thread::get_id()];
+			if (!p_state) p_state = unique_ptr<reader_state>(new reader_state(fd));
+			last_reader_generation = reader_generation;
+			last_reader_state = p_state.get();
+			return p_state.get();
+#else
+			assert(false); return nullptr; // enable_concurrent_readers() won't let us get here
+#endif
+		}
+		
+		void root_die::release_this_reader()
+		{
+			if (!concurrent_readers) return;
+#ifndef NO_TLS
+			std::lock_guard<std::mutex> guard(readers_lock);
+			readers.erase(std::this_thread::get_id());
+			if (last_reader_generation == reader_generation)
+			{
+				last_reader_generation = 0;
+				last_reader_state = nullptr;
+			}
+#endif
+		}
+		
+		Dwarf_Debug root_die::dbg_for_this_thread()
+		{
+			if (!concurrent_readers) return dbg.raw_handle();
+			return this_reader()->dbg.raw_handle();
+		}
+		
+		root_die::ptr_type root_die::make_shared_sticky(Dwarf_Off off)
+		{
+			/* Make it on dbg, not on this thread's Debug, since any reader
+			 * may use it. Then publish it, unless somebody beat us to it. */
+			ptr_type p;
+			{
+				std::lock_guard<std::recursive_mutex> guard(shared_dbg_lock);
+				Dwarf_Die returned;
+				if (dwarf_offdie(dbg.raw_handle(), off, &returned, &current_dwarf_error) != DW_DLV_OK)
+				{
+					throw Error(current_dwarf_error, 0);
+				}
+				Die d(Die::handle_type(returned, Die::deleter(dbg.raw_handle(), *this)));
+				p = factory::for_spec(d.spec_here(*this)).make_payload(std::move(d.handle), *this);
+			}
+			ptr_type published = shared_sticky_dies.insert(off, p).first;
+			if (published != p)
+			{
+				// our copy's handle is on dbg too, so drop it under the lock
+				std::lock_guard<std::recursive_mutex> guard(shared_dbg_lock);
+				p.reset();
+			}
+			return published;
+		}
+		
+		bool root_die::enable_concurrent_readers(unsigned nthreads)
+		{
+			if (concurrent_readers) return true;
+#ifdef NO_TLS
+			/* current_dwarf_error is shared, so libdwarf errors would be 
+			 * reported to the wrong thread. */
+			return false;
+#else
+			if (fd == -1 || !dbg.handle) return false;
+			
+			/* Build everything that navigation would otherwise build 
+			 * lazily. After this, readers only read it. */
+			ensure_cu_headers();
+			build_index(nthreads);
+			get_elf();
+			get_native_reader();
+			init_accelerator();
+			ensure_cu_address_ranges();
+			if (!visible_named_grandchildren_is_complete)
+			{
+				/* As in write_index(), record them all. */
+				visible_named_grandchildren.clear();
+				for (auto i_t = cu_topologies.begin(); i_t != cu_topologies.end(); ++i_t)
+				{
+					const cu_topology& t = i_t->second;
+					for (cu_topology::ordinal_t o = 0; o < t.size(); ++o)
+					{
+						if (t.depth_of(o) != 2) continue;
+						auto name = pos(t.offsets[o], 2).name_here();
+						if (name) visible_named_grandchildren.insert(make_pair(*name, t.offsets[o]));
+					}
+				}
+				visible_named_grandchildren_is_complete = true;
+			}
+			/* Sticky payloads made before now hold handles on dbg, as will
+			 * the shared ones that readers make. */
+			for (auto i_s = sticky_dies.begin(); i_s != sticky_dies.end(); ++i_s)
+			{
+				shared_sticky_dies.insert(i_s->first, i_s->second);
+			}
+			payload_alloc.set_shared(true);
+			reader_generation = next_reader_generation++;
+			concurrent_readers = true;
+			return true;
+#endif
+		}
+		
+		void root_die::disable_concurrent_readers()
+		{
+			if (!concurrent_readers) return;
+#ifndef NO_TLS
+			/* The shared sticky payloads are on dbg, so they can stay, back 
+			 * where the sequential code looks for them. */
+			shared_sticky_dies.for_each([this](const Dwarf_Off& off, const ptr_type& p) {
+				sticky_dies.insert(make_pair(off, p));
+			});
+			shared_sticky_dies.clear();
+			/* The readers' Debugs go. Other threads may still remember their
+			 * state, but under this generation, which we never reuse (see
+			 * enable_concurrent_readers()); we forget ours now. */
+			{
+				std::lock_guard<std::mutex> guard(readers_lock);
+				readers.clear();
+			}
+			if (last_reader_generation == reader_generation)
+			{
+				last_reader_generation = 0;
+				last_reader_state = nullptr;
+			}
+			payload_alloc.set_shared(false);
+			concurrent_readers = false;
+#endif
+		}
+		
+		void root_die::build_index(unsigned nthreads)
+		{
+			if (fd == -1 || !dbg.handle) return; // nothing to index
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			
+			/* Each worker has its own Debug. We also use the first one to list
+			 * the CUs, since that trashes its CU context. */
+			vector<Debug> worker_dbgs;
+			for (unsigned i = 0; i < nthreads; ++i) worker_dbgs.push_back(Debug(fd));
+			vector<Dwarf_Off> cu_offsets = cu_offsets_in(worker_dbgs[0].raw_handle());
+			
+			/* Skip any CUs we've already built. */
+			vector<Dwarf_Off> to_build;
+			for (auto i_cu = cu_offsets.begin(); i_cu != cu_offsets.end(); ++i_cu)
+			{
+				if (cu_topologies.find(*i_cu) == cu_topologies.end()) to_build.push_back(*i_cu);
+			}
+			
+			/* CUs vary a lot in size, so they're handed out one at a time
+			 * (see run_work_stealing()). Each worker writes only to its 
+			 * own slots of "built", using its own Debug. */
+			vector<cu_topology> built(to_build.size());
+			run_work_stealing(to_build.size(), [&worker_dbgs, &built, &to_build](unsigned i, unsigned worker) {
+				built[i].build(worker_dbgs[worker].raw_handle(), to_build[i]);
+			}, nthreads);
+			
+			/* Install the results. */
+			for (unsigned i = 0; i < to_build.size(); ++i)
+			{
+				cu_topologies[to_build[i]] = std::move(built[i]);
+				descent_parents.erase(to_build[i]);
+			}
+		}
+		
+		void root_die::ensure_scope_index()
+		{
+			if (have_scope_index) return;
+			assert(!concurrent_readers); // see enable_concurrent_readers()
+			
+			/* We paint each scope's intervals onto a map from segment start 
+			 * to scope, in depth-first order, so that inner scopes overwrite
+			 * outer ones. Each key holds until the next key; NO_PARENT 
+			 * means "no scope". */
+			map<Dwarf_Addr, unsigned> painted;
+			auto scope_at = [&painted](Dwarf_Addr addr) -> unsigned {
+				auto found = painted.upper_bound(addr);
+				if (found == painted.begin()) return address_scope::NO_PARENT;
+				return (--found)->second;
+			};
+			auto paint = [&painted, scope_at](Dwarf_Addr begin, Dwarf_Addr end, unsigned scope) {
+				/* An empty interval (e.g. low_pc == high_pc) covers nothing; 
+				 * painting it would write a key at begin with no resume key
+				 * after it, claiming everything up to the next key. */
+				if (begin >= end) return;
+				unsigned resume = scope_at(end);
+				painted.erase(painted.lower_bound(begin), painted.lower_bound(end));
+				painted[begin] = scope;
+				if (painted.find(end) == painted.end()) painted[end] = resume;
+			};
+			
+			/* Walk the topologies rather than the DIEs, so that we only 
+			 * materialise the scope DIEs. */
+			build_index();
+			scope_table.clear();
+			auto cus = children();
+			for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+			{
+				const cu_topology *p_t = topology_for_cu(i_cu.base().base().offset_here());
+				if (!p_t) continue;
+				/* The innermost enclosing scopes we've seen, with their depths. */
+				vector<unsigned> open_scopes;
+				for (cu_topology::ordinal_t o = 0; o < p_t->size(); ++o)
+				{
+					Dwarf_Half tag = p_t->tag_of(o);
+					if (tag != DW_TAG_compile_unit && tag != DW_TAG_subprogram
+						&& tag != DW_TAG_lexical_block && tag != DW_TAG_inlined_subroutine)
+					{
+						continue;
+					}
+					unsigned short depth = p_t->depth_of(o);
+					while (!open_scopes.empty() && scope_table[open_scopes.back()].depth >= depth)
+					{
+						open_scopes.pop_back();
+					}
+					
+					auto i_scope = pos(p_t->offsets[o], depth).as_a<with_static_location_die>();
+					if (!i_scope) continue;
+					auto intervals = i_scope->file_relative_intervals(*this, nullptr, nullptr);
+					/* Out-of-line declarations, abstract instances and the like
+					 * have no addresses. Their children won't either. */
+					if (intervals.begin() == intervals.end()) continue;
+					
+					unsigned idx = scope_table.size();
+					scope_table.push_back(address_scope { 
+						p_t->offsets[o], depth, 
+						open_scopes.empty() ? address_scope::NO_PARENT : open_scopes.back()
+					});
+					open_scopes.push_back(idx);
+					for (auto i_int = intervals.begin(); i_int != intervals.end(); ++i_int)
+					{
+						paint(i_int->first.lower(), i_int->first.upper(), idx);
+					}
+				}
+			}
+			
+			/* Flatten the map into segments. */
+			scope_segments.clear();
+			for (auto i_p = painted.begin(); i_p != painted.end(); ++i_p)
+			{
+				if (i_p->second == address_scope::NO_PARENT) continue;
+				auto next = i_p; ++next;
+				assert(next != painted.end()); // every segment has an end key
+				scope_segments.push_back(scope_segment { i_p->first, next->first, i_p->second });
+			}
+			have_scope_index = true;
+		}
+		
+		vector<iterator_base> root_die::scopes_at(Dwarf_Addr file_relative_addr)
+		{
+			ensure_scope_index();
+			vector<iterator_base> chain;
+			scope_segment key = { file_relative_addr, 0, 0 };
+			auto found = std::upper_bound(scope_segments.begin(), scope_segments.end(), key);
+			if (found == scope_segments.begin()) return chain;
+			--found;
+			if (file_relative_addr >= found->end) return chain;
+			for (unsigned idx = found->scope; idx != address_scope::NO_PARENT; 
+				idx = scope_table[idx].parent)
+			{
+				chain.push_back(pos(scope_table[idx].offset, scope_table[idx].depth));
+			}
+			return chain;
+		}
+		
+		/* Append an edge for every reference-class attribute of every DIE in
+		 * a CU, using the topology to enumerate DIEs. We go straight to 
+		 * libdwarf and look only at forms, so no other attribute gets decoded. 
+		 * DW_AT_sibling is included; referrers_of() skips it. */
+		static void reference_edges_in(Dwarf_Debug dbg, const cu_topology& t, 
+			vector<reference_edge>& out)
+		{
+			for (cu_topology::ordinal_t o = 0; o < t.size(); ++o)
+			{
+				Dwarf_Die d;
+				int ret = dwarf_offdie(dbg, t.offsets[o], &d, &current_dwarf_error);
+				if (ret != DW_DLV_OK) throw Error(current_dwarf_error, 0);
+				Dwarf_Attribute *attrs;
+				Dwarf_Signed nattrs;
+				ret = dwarf_attrlist(d, &attrs, &nattrs, &current_dwarf_error);
+				if (ret == DW_DLV_ERROR) throw Error(current_dwarf_error, 0);
+				if (ret == DW_DLV_NO_ENTRY) nattrs = 0;
+				for (Dwarf_Signed i = 0; i < nattrs; ++i)
+				{
+					Dwarf_Half form, attr;
+					if (dwarf_whatform(attrs[i], &form, &current_dwarf_error) == DW_DLV_OK
+						&& dwarf_whatattr(attrs[i], &attr, &current_dwarf_error) == DW_DLV_OK)
+					{
+						switch (form)
+						{
+							case DW_FORM_ref_addr:
+							case DW_FORM_ref1:
+							case DW_FORM_ref2:
+							case DW_FORM_ref4:
+							case DW_FORM_ref8:
+							case DW_FORM_ref_udata: {
+								Dwarf_Off target;
+								if (dwarf_global_formref(attrs[i], &target, 
+									&current_dwarf_error) == DW_DLV_OK)
+								{
+									out.push_back(reference_edge { target, t.offsets[o], attr });
+								}
+							} break;
+							default: break;
+						}
+					}
+					dwarf_dealloc(dbg, attrs[i], DW_DLA_ATTR);
+				}
+				if (nattrs > 0) dwarf_dealloc(dbg, attrs, DW_DLA_LIST);
+				dwarf_dealloc(dbg, d, DW_DLA_DIE);
+			}
+		}
+		
+		void root_die::build_reverse_references(unsigned nthreads)
+		{
+			if (have_reverse_refs) return;
+			assert(!concurrent_readers); // see enable_concurrent_readers()
+			if (!have_file_reverse_refs && dbg.handle) build_file_reverse_references(nthreads);
+			have_file_reverse_refs = true;
+			
+			/* Now the in-memory DIEs, which can change under us: drop any 
+			 * edges we had from them and read their attributes afresh. */
+			std::set<Dwarf_Off> in_memory;
+			vector<reference_edge> in_memory_edges;
+			for (auto i_d = sticky_dies.begin(); i_d != sticky_dies.end(); ++i_d)
+			{
+				auto p_in_mem = dynamic_cast<in_memory_abstract_die *>(i_d->second.get());
+				if (!p_in_mem) continue;
+				in_memory.insert(i_d->first);
+				for (auto i_a = p_in_mem->m_attrs.begin(); i_a != p_in_mem->m_attrs.end(); ++i_a)
+				{
+					if (i_a->second.get_form() == encap::attribute_value::REF)
+					{
+						in_memory_edges.push_back(reference_edge { 
+							i_a->second.get_ref().off, i_d->first, i_a->first });
+					}
+				}
+			}
+			reverse_refs.erase(std::remove_if(reverse_refs.begin(), reverse_refs.end(),
+				[&in_memory](const reference_edge& e) { 
+					return in_memory.find(e.referrer) != in_memory.end(); 
+				}), reverse_refs.end());
+			/* What's left is still sorted, so we only sort the new edges. */
+			std::sort(in_memory_edges.begin(), in_memory_edges.end());
+			size_t n_kept = reverse_refs.size();
+			reverse_refs.insert(reverse_refs.end(), in_memory_edges.begin(), in_memory_edges.end());
+			std::inplace_merge(reverse_refs.begin(), reverse_refs.begin() + n_kept, reverse_refs.end());
+			have_reverse_refs = true;
+		}
+		
+		void root_die::build_file_reverse_references(unsigned nthreads)
+		{
+			/* We need every topology anyway, to enumerate the DIEs. */
+			build_index(nthreads);
+			vector<const cu_topology *> cus;
+			for (auto i_t = cu_topologies.begin(); i_t != cu_topologies.end(); ++i_t)
+			{
+				cus.push_back(&i_t->second);
+			}
+			
+			/* As in build_index(), each worker reads with its own Debug and
+			 * writes one output slot per CU. Without a file descriptor we 
+			 * can't open more Debugs, so use ours, serially. */
+			if (fd == -1) nthreads = 1;
+			else if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			vector<Debug> worker_dbgs;
+			if (fd != -1) for (unsigned i = 0; i < nthreads; ++i) worker_dbgs.push_back(Debug(fd));
+			vector< vector<reference_edge> > edges(cus.size());
+			run_work_stealing(cus.size(), [this, &worker_dbgs, &cus, &edges](unsigned i, unsigned worker) {
+				Dwarf_Debug worker_dbg = (fd == -1) ? dbg.raw_handle() 
+					: worker_dbgs[worker].raw_handle();
+				reference_edges_in(worker_dbg, *cus[i], edges[i]);
+			}, nthreads);
+			
+			reverse_refs.clear();
+			size_t total = 0;
+			for (auto i_cu = edges.begin(); i_cu != edges.end(); ++i_cu) total += i_cu->size();
+			reverse_refs.reserve(total);
+			for (auto i_cu = edges.begin(); i_cu != edges.end(); ++i_cu)
+			{
+				reverse_refs.insert(reverse_refs.end(), i_cu->begin(), i_cu->end());
+			}
+			std::sort(reverse_refs.begin(), reverse_refs.end());
+		}
+		
+		vector<pair<Dwarf_Off, Dwarf_Half> > root_die::referrers_of(Dwarf_Off off)
+		{
+			build_reverse_references();
+			vector<pair<Dwarf_Off, Dwarf_Half> > referrers;
+			reference_edge key = { off, 0, 0 };
+			for (auto i_e = std::lower_bound(reverse_refs.begin(), reverse_refs.end(), key);
+				i_e != reverse_refs.end() && i_e->target == off; ++i_e)
+			{
+				if (i_e->attr == DW_AT_sibling) continue;
+				referrers.push_back(make_pair(i_e->referrer, i_e->attr));
+			}
+			return referrers;
+		}
+		
+		pair<const cu_topology *, cu_topology::ordinal_t> 
+		root_die::topology_position(const iterator_base& it)
+		{
+			auto none = make_pair((const cu_topology *) nullptr, cu_topology::NONE);
+			if (!it.is_real_die_position()) return none;
+			Dwarf_Off off = it.offset_here();
+			const cu_topology *p_t = topology_containing(off);
+			if (!p_t)
+			{
+				// only libdwarf-backed DIEs can have a topology
+				if (!it.libdwarf_handle()) return none;
+				p_t = topology_for_cu(it.enclosing_cu_offset_here());
+				if (!p_t) return none;
+			}
+			cu_topology::ordinal_t o = p_t->ordinal_of(off);
+			if (o == cu_topology::NONE) return none;
+			return make_pair(p_t, o);
+		}
+		
 		/* Moving around, there are a few concerns to deal with. 
 		 * 1. maintaining the parent cache
 		 * 2. exploiting the parent cache
@@ -331,17 +1074,27 @@ namespace dwarf
 			else
 			{
 				assert(it.get_depth() > 0);
-				auto found = parent_of.find(it.offset_here());
-				if (found == parent_of.end()) 
+				/* If find_downwards() stepped over us, it recorded our parent,
+				 * which saves building the topology. */
+				if (!topology_containing(it.offset_here()))
 				{
-					// find ourselves downwards, then try again
-					cerr << "Warning: searching for parent of " << it << " all the way from root." << endl;
-					auto found_again = find_downwards(it.offset_here());
-					found = parent_of.find(it.offset_here());
+					optional<Dwarf_Off> descended = descent_parent_of(it.offset_here());
+					if (descended) return pos(*descended, it.depth() - 1, optional<Dwarf_Off>());
 				}
+				/* libdwarf-backed DIEs get their parent from the topology. */
+				auto topo_pos = topology_position(it);
+				if (topo_pos.first)
+				{
+					const cu_topology& t = *topo_pos.first;
+					assert(t.parent[topo_pos.second] != cu_topology::NONE);
+					Dwarf_Off parent_off = t.offsets[t.parent[topo_pos.second]];
+					return pos(parent_off, it.depth() - 1, optional<Dwarf_Off>());
+				}
+				
+				/* Otherwise we're in memory, so the parent cache must know. */
+				auto found = parent_of.find(it.offset_here());
 				assert(found != parent_of.end());
 				assert(found->first == it.offset_here());
-				assert(found->second < it.offset_here());
 				//cerr << "Parent cache says parent of 0x" << std::hex << found->first
 				// << " is 0x" << std::hex << found->second << std::dec << endl;
 				
@@ -371,8 +1124,7 @@ namespace dwarf
 			if (maybe_parent != iterator_base::END) 
 			{
 				/* check we really got the parent! */
-				assert(parent_of.find(it.offset_here()) != parent_of.end());
-				assert(maybe_parent.offset_here() == parent_of[it.offset_here()]);
+				assert(maybe_parent.depth() + 1 == it.depth());
 				it = std::move(maybe_parent); 
 				return true; 
 			}
@@ -393,33 +1145,48 @@ namespace dwarf
 			Dwarf_Off start_offset = it.offset_here();
 			Die::handle_type maybe_handle(nullptr, Die::deleter(nullptr)); // TODO: reenable deleter's default constructor
 			
-			// check for cached edges 
-			auto found = first_child_of.find(start_offset);
-			if (found != first_child_of.end())
+			// check for known edges -- first in the topology, if we've built it...
+			opt<Dwarf_Off> known_child;
+			const cu_topology *p_t = topology_containing(start_offset);
+			cu_topology::ordinal_t o = p_t ? p_t->ordinal_of(start_offset) : cu_topology::NONE;
+			if (o != cu_topology::NONE && p_t->first_child[o] != cu_topology::NONE)
+			{
+				known_child = p_t->offsets[p_t->first_child[o]];
+			}
+			else // ... then in the in-memory edges
+			{
+				auto found = first_child_of.find(start_offset);
+				if (found != first_child_of.end()) known_child = found->second;
+			}
+			if (known_child)
 			{
-				auto found_sticky = sticky_dies.find(found->second);
-				if (found_sticky != sticky_dies.end())
+				auto found_sticky = find_sticky(*known_child);
+				if (found_sticky)
 				{
-					return iterator_base(static_cast<abstract_die&&>(*found_sticky->second), it.depth() + 1, *this);
+					return iterator_base(static_cast<abstract_die&&>(*found_sticky), it.depth() + 1, *this);
 				} // else fall through
 			}
 			
 			// populate maybe_handle with the first child DIE's handle
 			if (start_offset == 0UL) 
 			{
-				// do the CU thing
-				bool ret1 = clear_cu_context();
-				assert(ret1);
-				bool ret2 = advance_cu_context(); 
-				if (!ret2)
+				/* Do the CU thing. The first CU comes from the header table, 
+				 * so we don't touch libdwarf's CU cursor. */
+				ensure_cu_headers();
+				if (cu_headers.empty())
 				{
 					/* We don't have any CUs *in the dwarf file*. 
 					 * And if we had one in memory, we'd have found it earlier. */
 					return iterator_base::END;
 				}
-				maybe_handle = std::move(Die::try_construct(*this));
-				
-				if (maybe_handle) first_child_of[0UL] = current_cu_offset;
+				maybe_handle = std::move(Die::try_construct(*this, cu_headers.front().cu_offset));
+			}
+			else if (concurrent_readers)
+			{
+				/* it may be a shared payload, whose handle we mustn't use. 
+				 * But the topologies are complete, so use them. */
+				if (!known_child) return iterator_base::END;
+				maybe_handle = std::move(Die::try_construct(*this, *known_child));
 			}
 			else
 			{
@@ -427,14 +1194,9 @@ namespace dwarf
 				// FIXME: in-memory case
 				maybe_handle = std::move(Die::try_construct(it));
 			}
-			// shared parent cache logic
 			if (maybe_handle)
 			{
-				iterator_base new_it(Die(std::move(maybe_handle)), it.get_depth() + 1, it.get_root());
-				// install in parent cache, first_child_of
-				parent_of[new_it.offset_here()] = start_offset;
-				first_child_of[start_offset] = new_it.offset_here();
-				return new_it;
+				return iterator_base(Die(std::move(maybe_handle)), it.get_depth() + 1, it.get_root());
 			} else return iterator_base::END;
 		}
 		
@@ -452,30 +1214,63 @@ namespace dwarf
 		iterator_base 
 		iterator_base::named_child(const string& name) const
 		{
-			if (state == WITH_PAYLOAD) 
+			/* DIEs that can have named children get a hash table of them 
+			 * in the root, built on the first lookup. If we have a payload,
+			 * ask it, in case it knows better; otherwise go straight to 
+			 * the table, without making a payload just for this. */
+			if (is_real_die_position() && is_a<with_named_children_die>())
 			{
-				/* This means we *can* ask the payload. What will the 
-				 * payload do by default? Call the root, of course. 
-				 * (But some payloads might be smarter.) */
-				auto p_with = dynamic_pointer_cast<with_named_children_die>(cur_payload);
-				if (p_with)
+				if (state == WITH_PAYLOAD)
+				{
+					auto p_with = dynamic_pointer_cast<with_named_children_die>(cur_payload);
+					if (p_with) return p_with->named_child(name, *p_root);
+				}
+				const root_die::named_children_table *p_table = p_root->named_children_of(offset_here(), this);
+				if (p_table)
 				{
-					return p_with->named_child(name, *p_root);
+					auto found = p_table->find(name);
+					if (found == p_table->end()) return iterator_base::END;
+					return p_root->pos(found->second.front(), depth() + 1, offset_here());
 				}
 			}
 			return p_root->find_named_child(*this, name);
 		}
 		
+		const root_die::named_children_table *
+		root_die::named_children_of(Dwarf_Off off, const iterator_base *p_self)
+		{
+			std::unique_lock<std::mutex> guard(cached_named_children_lock, std::defer_lock);
+			if (concurrent_readers) guard.lock();
+			auto found = cached_named_children.find(off);
+			if (found != cached_named_children.end()) return found->second.get();
+			
+			/* Walk the children once. If we have to find ourselves, don't
+			 * hold the lock while we do. */
+			if (guard.owns_lock()) guard.unlock();
+			unique_ptr<named_children_table> p_table(new named_children_table());
+			iterator_base self = p_self ? *p_self : find(off);
+			auto children = self.children_here();
+			for (auto i_child = std::move(children.first); i_child != children.second; ++i_child)
+			{
+				if (!i_child.libdwarf_handle()) { p_table.reset(); break; } // in memory
+				auto child_name = i_child.name_view_here();
+				if (child_name) (*p_table)[string(child_name->begin(), child_name->end())]
+					.push_back(i_child.offset_here());
+			}
+			if (concurrent_readers) guard.lock();
+			// if another reader beat us to it, theirs is just as good
+			return cached_named_children.insert(make_pair(off, std::move(p_table))).first->second.get();
+		}
+		
 		iterator_base
 		root_die::find_named_child(const iterator_base& start, const string& name)
 		{
 			auto children = start.children_here();
 			for (auto i_child = std::move(children.first); i_child != children.second; ++i_child)
 			{
-				// /* Use strcmp because name_here returns us a fancy char*, not a std::string. */
-				//if (i_child.get_raw_name() != nullptr
-				// 	&& 0 == strcmp(i_child.get_raw_name().get(), name.c_str()))
-				if (i_child.name_here() && *i_child.name_here() == name)
+				/* A view, so that the comparison doesn't copy the name. */
+				auto child_name = i_child.name_view_here();
+				if (child_name && *child_name == name)
 				{
 					return std::move(i_child);
 				}
@@ -636,33 +1431,69 @@ namespace dwarf
 			if (!it.is_real_die_position()) return iterator_base::END;
 
 			Dwarf_Off offset_here = it.offset_here();
-			// check for cached edges 
-			auto found = next_sibling_of.find(offset_here);
-			if (found != next_sibling_of.end())
+			bool is_cu = (it.tag_here() == DW_TAG_compile_unit);
+			// check for known edges, topology first (as in first_child())
+			opt<Dwarf_Off> known_sibling;
+			bool known_last = false;
+			const cu_topology *p_t = topology_containing(offset_here);
+			cu_topology::ordinal_t o = p_t ? p_t->ordinal_of(offset_here) : cu_topology::NONE;
+			if (o != cu_topology::NONE && p_t->next_sibling[o] != cu_topology::NONE)
 			{
-				auto found_sticky = sticky_dies.find(found->second);
-				if (found_sticky != sticky_dies.end())
+				known_sibling = p_t->offsets[p_t->next_sibling[o]];
+			}
+			else
+			{
+				auto found = next_sibling_of.find(offset_here);
+				if (found != next_sibling_of.end()) known_sibling = found->second;
+				/* The topology knows where every sibling list ends, so
+				 * if it says we're last (and nothing was added in memory
+				 * after us), we are. */
+				else known_last = (o != cu_topology::NONE);
+			}
+			if (!known_sibling && !known_last && !is_cu && it.libdwarf_handle())
+			{
+				/* Don't make libdwarf step through our subtree. The native 
+				 * reader hops over it using DW_AT_sibling if we have it, 
+				 * and otherwise just skips bytes using the abbreviations. */
+				native_reader *p_r = get_native_reader();
+				const native_reader::unit *p_u = p_r ? p_r->unit_containing(offset_here) : nullptr;
+				native_die d = p_u ? native_die(*p_r, *p_u, p_r->info_at(offset_here)) : native_die();
+				if (d)
 				{
-					return iterator_base(static_cast<abstract_die&&>(*found_sticky->second), it.depth(), *this);
+					native_die sib = d.next_sibling();
+					if (sib) known_sibling = sib.get_offset();
+					else known_last = true;
+				}
+			}
+			if (known_last && !is_cu) return iterator_base::END;
+			if (known_sibling)
+			{
+				auto found_sticky = find_sticky(*known_sibling);
+				if (found_sticky)
+				{
+					return iterator_base(static_cast<abstract_die&&>(*found_sticky), it.depth(), *this);
 				} // else fall through
 			}
 			
-			auto found_parent = parent_of.find(offset_here);
-			// if we issued `it', we should have recorded its parent
-			// FIXME: relax this policy perhaps, to allow soft cache?
-			assert(found_parent != parent_of.end());
-			Dwarf_Off common_parent_offset = found_parent->second;
 			Die::handle_type maybe_handle(nullptr, Die::deleter(nullptr)); // TODO: reenable deleter default constructor
 			
-			if (it.tag_here() == DW_TAG_compile_unit)
+			if (is_cu)
 			{
-				// do the CU thing
-				bool ret = set_cu_context(it.offset_here());
-				if (!ret) return iterator_base::END; // i.e. we're not a libdwarf-backed CU
-				ret = advance_cu_context();
-				if (!ret) return iterator_base::END;
-				maybe_handle = Die::try_construct(*this);
-				if (maybe_handle) next_sibling_of[it.offset_here()] = current_cu_offset;
+				// do the CU thing -- as in first_child(), using the header table
+				const cu_header_info *p_h = cu_header_for(offset_here);
+				if (!p_h) return iterator_base::END; // i.e. we're not a libdwarf-backed CU
+				if (p_h + 1 == cu_headers.data() + cu_headers.size()) return iterator_base::END;
+				maybe_handle = Die::try_construct(*this, (p_h + 1)->cu_offset);
+			}
+			else if (known_sibling)
+			{
+				// we know where it is, so just go there
+				maybe_handle = Die::try_construct(*this, *known_sibling);
+			}
+			else if (concurrent_readers)
+			{
+				// as in first_child()
+				return iterator_base::END;
 			}
 			else
 			{
@@ -670,14 +1501,9 @@ namespace dwarf
 				maybe_handle = Die::try_construct(*this, it);
 			}
 			
-			// shared parent cache logic
 			if (maybe_handle)
 			{
-				auto new_it = iterator_base(Die(std::move(maybe_handle)), it.get_depth(), *this);
-				// install in parent cache
-				parent_of[new_it.offset_here()] = common_parent_offset;
-				next_sibling_of[offset_here] = new_it.offset_here();
-				return new_it;
+				return iterator_base(Die(std::move(maybe_handle)), it.get_depth(), *this);
 			} else return iterator_base::END;
 		}
 		
@@ -696,6 +1522,89 @@ namespace dwarf
 			else return false;
 		}
 		
+		pair<const Dwarf_Off *, const Dwarf_Off *>
+		root_die::child_offsets(const iterator_base& it)
+		{
+			if (it.is_end_position()) return make_pair(nullptr, nullptr);
+			assert(&it.get_root() == this);
+			Dwarf_Off off = it.is_root_position() ? 0UL : it.offset_here();
+			
+			/* The topology lists libdwarf-backed DIEs' children, unless 
+			 * some in-memory ones were added after them. */
+			if (it.is_real_die_position() && it.libdwarf_handle())
+			{
+				const cu_topology *p_t = topology_containing(off);
+				if (!p_t && !concurrent_readers) p_t = topology_for_cu(it.enclosing_cu_offset_here());
+				cu_topology::ordinal_t o = p_t ? p_t->ordinal_of(off) : cu_topology::NONE;
+				if (o != cu_topology::NONE)
+				{
+					auto children = p_t->children_of(o);
+					bool more_in_memory = (children.first == children.second)
+						? first_child_of.find(off) != first_child_of.end()
+						: next_sibling_of.find(*(children.second - 1)) != next_sibling_of.end();
+					if (!more_in_memory) return children;
+				}
+			}
+			
+			/* Otherwise, walk them once and remember. */
+			std::unique_lock<std::mutex> guard(cached_child_offsets_lock, std::defer_lock);
+			if (concurrent_readers) guard.lock();
+			auto found = cached_child_offsets.find(off);
+			if (found == cached_child_offsets.end())
+			{
+				vector<Dwarf_Off> offs;
+				for (iterator_base c = first_child(it); c != iterator_base::END; c = next_sibling(c))
+				{
+					offs.push_back(c.offset_here());
+				}
+				found = cached_child_offsets.insert(make_pair(off, std::move(offs))).first;
+			}
+			const Dwarf_Off *base = found->second.data();
+			return make_pair(base, base + found->second.size());
+		}
+		
+		iterator_base
+		root_die::nth_child(const iterator_base& it, unsigned n)
+		{
+			auto offs = child_offsets(it);
+			if (n >= (unsigned)(offs.second - offs.first)) return iterator_base::END;
+			Dwarf_Off parent_off = it.is_root_position() ? 0UL : it.offset_here();
+			return pos(offs.first[n], it.depth() + 1, parent_off);
+		}
+		
+		iterator_base
+		root_die::last_child(const iterator_base& it)
+		{
+			auto offs = child_offsets(it);
+			if (offs.first == offs.second) return iterator_base::END;
+			Dwarf_Off parent_off = it.is_root_position() ? 0UL : it.offset_here();
+			return pos(*(offs.second - 1), it.depth() + 1, parent_off);
+		}
+		
+		iterator_base
+		root_die::prev_sibling(const iterator_base& it)
+		{
+			if (!it.is_real_die_position()) return iterator_base::END;
+			iterator_base p = parent(it);
+			if (p == iterator_base::END) return iterator_base::END;
+			/* Siblings come in offset order, so we can binary-search for 
+			 * ourselves. */
+			auto offs = child_offsets(p);
+			const Dwarf_Off *found = std::lower_bound(offs.first, offs.second, it.offset_here());
+			assert(found != offs.second && *found == it.offset_here());
+			if (found == offs.first) return iterator_base::END;
+			Dwarf_Off parent_off = p.is_root_position() ? 0UL : p.offset_here();
+			return pos(*(found - 1), it.depth(), parent_off);
+		}
+		
+		bool 
+		root_die::move_to_prev_sibling(iterator_base& it)
+		{
+			auto maybe_sibling = prev_sibling(it);
+			if (maybe_sibling != iterator_base::END) { it = std::move(maybe_sibling); return true; }
+			else return false;
+		}
+		
 /* Here comes the factory. */
 		root_die::ptr_type 
 		root_die::make_payload(const iterator_base& it) // note: we update *mutable* fields
@@ -714,11 +1623,30 @@ namespace dwarf
 				// Whenever we construct an iterator, we build sticky payload if necessary.
 				assert(!is_sticky(it.get_handle()));
 				
+				/* Maybe we kept one from last time. */
+				Dwarf_Off off = it.offset_here();
+				payload_cache *p_cache = payload_cache_here();
+				if (p_cache)
+				{
+					ptr_type p = p_cache->get(off);
+					if (p)
+					{
+						it.cur_handle = Die(nullptr, nullptr);
+						it.cur_payload = p;
+						it.state = iterator_base::WITH_PAYLOAD;
+						return it.cur_payload;
+					}
+				}
+				
 				/* heap-allocate the right kind of basic_die, 
 				 * creating the intrusive ptr, hence bumping the refcount */
 				it.cur_payload = core::factory::for_spec(it.spec_here())
-					.make_payload(std::move(dynamic_cast<Die&>(it.get_handle()).handle), *this);
+					.make_payload(std::move(it.cur_handle.handle), *this);
 				it.state = iterator_base::WITH_PAYLOAD;
+				/* We charge the cache for the object itself, not for anything 
+				 * it points to; that's close enough for a budget. */
+				if (p_cache) p_cache->put(off, it.cur_payload,
+					payload_allocator::allocation_size(dynamic_cast<void *>(it.cur_payload.get())));
 				
 #ifdef DWARFPP_WARN_ON_INEFFICIENT_USAGE
 				if (it.tag_here() != DW_TAG_compile_unit)
@@ -730,16 +1658,27 @@ namespace dwarf
 			}
 		}
 		
+		void root_die::set_payload_cache(unique_ptr<payload_cache> p_cache)
+		{
+			if (p_payload_cache) p_payload_cache->clear();
+			p_payload_cache = std::move(p_cache);
+		}
+		
 		iterator_base
 		root_die::make_new(const iterator_base& parent, Dwarf_Half tag)
 		{
 			/* heap-allocate the right kind of (in-memory) DIE, 
 			 * creating the intrusive ptr, hence bumping the refcount */
+			assert(!concurrent_readers);
 			auto& spec = parent.is_root_position() ? DEFAULT_DWARF_SPEC : parent.enclosing_cu().spec_here();
 			root_die::ptr_type p = core::factory::for_spec(spec).make_new(parent, tag);
 			Dwarf_Off o = dynamic_cast<in_memory_abstract_die&>(*p).get_offset();
 			sticky_dies.insert(make_pair(o, p));
 			parent_of.insert(make_pair(o, parent.offset_here()));
+			cached_child_offsets.erase(parent.offset_here());
+			cached_named_children.erase(parent.offset_here());
+			/* Its references (once it has some) aren't in the index yet. */
+			have_reverse_refs = false;
 			auto found = find(o);
 			assert(found);
 			return found;
@@ -765,10 +1704,10 @@ namespace dwarf
 			switch (d.tag_here())
 			{
 #define factory_case(name, ...) \
-case DW_TAG_ ## name: p = new name ## _die(d.spec_here(r), std::move(d.handle)); break; // FIXME: not "basic_die"...
+case DW_TAG_ ## name: p = new (r.get_payload_allocator()) name ## _die(d.spec_here(r), std::move(d.handle)); break; // FIXME: not "basic_die"...
 #include "dwarf3-factory.h"
 #undef factory_case
-				default: p = new basic_die(d.spec_here(r), std::move(d.handle)); break;
+				default: p = new (r.get_payload_allocator()) basic_die(d.spec_here(r), std::move(d.handle)); break;
 			}
 			return p;
 		}
@@ -780,21 +1719,21 @@ case DW_TAG_ ## name: p = new name ## _die(d.spec_here(r), std::move(d.handle));
 			// so on... for now, just construct the thing.
 			Die d(std::move(h));
 			Dwarf_Off off = d.offset_here();
-			auto p = new compile_unit_die(dwarf::spec::dwarf3, std::move(d.handle));
+			auto p = new (r.get_payload_allocator()) compile_unit_die(dwarf::spec::dwarf3, std::move(d.handle));
 			/* fill in the CU fields -- this code would be shared by all 
 			 * factories, so we put it here (but HMM, if our factories were
 			 * a delegation chain, we could just put it in the root). */
 
-			bool ret = r.set_cu_context(off);
-			assert(ret);
+			const cu_header_info *p_h = r.cu_header_for(off);
+			assert(p_h);
 
-			p->cu_header_length = *r.last_seen_cu_header_length;
-			p->version_stamp = *r.last_seen_version_stamp;
-			p->abbrev_offset = *r.last_seen_abbrev_offset;
-			p->address_size = *r.last_seen_address_size;
-			p->offset_size = *r.last_seen_offset_size;
-			p->extension_size = *r.last_seen_extension_size;
-			p->next_cu_header = *r.last_seen_next_cu_header;
+			p->cu_header_length = p_h->cu_header_length;
+			p->version_stamp = p_h->version_stamp;
+			p->abbrev_offset = p_h->abbrev_offset;
+			p->address_size = p_h->address_size;
+			p->offset_size = p_h->offset_size;
+			p->extension_size = p_h->extension_size;
+			p->next_cu_header = p_h->next_cu_header;
 			
 			return p;
 		}
@@ -876,7 +1815,7 @@ case DW_TAG_ ## name: p = new name ## _die(d.spec_here(r), std::move(d.handle));
 
 			if (tag == DW_TAG_compile_unit)
 			{
-				return make_new_cu(r, [parent](){ return new in_memory_compile_unit_die(parent); });
+				return make_new_cu(r, [parent, &r](){ return new (r.get_payload_allocator()) in_memory_compile_unit_die(parent); });
 			}
 			
 			if (parent.depth() == 1) r.visible_named_grandchildren_is_complete = false;
@@ -889,7 +1828,7 @@ case DW_TAG_ ## name: p = new name ## _die(d.spec_here(r), std::move(d.handle));
 			{
 #define factory_case(name, ...) \
 case DW_TAG_ ## name: \
-			return new in_memory_ ## name ## _die(parent);
+			return new (r.get_payload_allocator()) in_memory_ ## name ## _die(parent);
 #include "dwarf3-factory.h"
 				default: return nullptr;
 			}
@@ -922,7 +1861,12 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			 * caller will still need the handle. 
 			 * HMM -- now tried changing it so the caller passes us the Die. */
 			
-			return d.get_tag() == DW_TAG_compile_unit;
+			/* Namespaces are sticky too, so that their named-children hash 
+			 * tables (see with_named_children_die) live as long as we do. In 
+			 * C++ code they can have tens of thousands of children, and 
+			 * rebuilding the table for every lookup would defeat the point. */
+			return d.get_tag() == DW_TAG_compile_unit
+				|| d.get_tag() == DW_TAG_namespace;
 		}
 		
 		void
@@ -930,25 +1874,55 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			map<Dwarf_Off, Dwarf_Off>& parent_of,
 			map<pair<Dwarf_Off, Dwarf_Half>, Dwarf_Off>& refers_to) const
 		{
-			/* We walk the whole tree depth-first. 
+			/* If we're backed by a file, the reverse-reference index has 
+			 * every reference already (in-memory DIEs' and DW_AT_sibling's
+			 * included); we just turn it around. */
+			if (dbg.handle)
+			{
+				auto nonconst_this = const_cast<root_die *>(this);
+				nonconst_this->build_reverse_references();
+				for (auto i_e = reverse_refs.begin(); i_e != reverse_refs.end(); ++i_e)
+				{
+					nonconst_this->refers_to.set(make_pair(i_e->referrer, i_e->attr), i_e->target);
+				}
+			}
+			/* Otherwise we visit the whole tree depth-first. 
 			 * If we see any attributes that are references, we follow them. 
 			 * Then we return our maps. */
-			for (auto i = begin(); i != end(); ++i)
+			else
 			{
-				encap::attribute_map attrs = i.copy_attrs(const_cast<root_die&>(*this)); //(i.attrs_here(), i.get_handle(), *this);
-				for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
-				{
-					if (i_a->second.get_form() == encap::attribute_value::REF)
+				auto nonconst_this = const_cast<root_die *>(this);
+				nonconst_this->visit([nonconst_this](const visited_die& d) {
+					attribute_view attrs = d.attrs();
+					for (auto i_a = attrs.begin(); i_a != attrs.end(); ++i_a)
 					{
-						auto found = const_cast<root_die *>(this)->find(
-							i_a->second.get_ref().off, 
-							make_pair(i.offset_here(), i_a->first));
+						auto value = i_a.value();
+						if (value.get_form() == encap::attribute_value::REF)
+						{
+							// only for the refers_to entry it records
+							nonconst_this->find(value.get_ref().off, 
+								make_pair(d.offset, i_a.attr()));
+						}
 					}
-				}
+					return CONTINUE;
+				});
 			}
 			
+			/* The parent cache only has in-memory and CU-level edges; 
+			 * the rest we read out of the topologies. */
 			parent_of = this->parent_of;
-			refers_to = this->refers_to;
+			for (auto i_t = cu_topologies.begin(); i_t != cu_topologies.end(); ++i_t)
+			{
+				const cu_topology& t = i_t->second;
+				parent_of[t.cu_offset] = 0UL;
+				for (cu_topology::ordinal_t o = 1; o < t.size(); ++o)
+				{
+					parent_of[t.offsets[o]] = t.offsets[t.parent[o]];
+				}
+			}
+			this->refers_to.for_each([&refers_to](const pair<Dwarf_Off, Dwarf_Half>& k, Dwarf_Off v) {
+				refers_to[k] = v;
+			});
 		}
 		
 		Dwarf_Off root_die::fresh_cu_offset()
@@ -961,7 +1935,8 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				return 1;
 			}
 			
-			Dwarf_Off biggest_cu_off = sticky_dies.rbegin()->second->get_offset();
+			// (not all sticky DIEs are CUs, so ask for the enclosing CU)
+			Dwarf_Off biggest_cu_off = sticky_dies.rbegin()->second->get_enclosing_cu_offset();
 			// in general, the biggest offset is the *last* item in depth-first order
 			// FIXME: faster way to do this
 			iterator_df<> i = cu_pos(biggest_cu_off);
@@ -981,29 +1956,20 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 		Dwarf_Off root_die::fresh_offset_under(const iterator_base& pos)
 		{
 			// NOTE: maintain the invariant that relates offsets with topology
-			iterator_df<> i = pos;
-			auto children = i.children_here();
-			auto prev_child = children.second;
-			
 			map<Dwarf_Off, Dwarf_Off> last_children_seen;
 			
 			std::function< iterator_df<>(const iterator_base&) > 
 			highest_offset_iter_in_subtree
-			 = [&highest_offset_iter_in_subtree, &last_children_seen](const iterator_base& t) {
-				auto children = t.children_here();
-				if (srk31::count(children.first, children.second) == 0)
+			 = [this, &highest_offset_iter_in_subtree, &last_children_seen](const iterator_base& t) {
+				iterator_base last_child = this->last_child(t);
+				if (last_child == iterator_base::END)
 				{
 					return iterator_df<>(t);
 				}
 				else
 				{
-					auto last_sib = children.first;
-					while (++children.first != children.second)
-					{
-						last_sib = children.first;
-					}
-					last_children_seen[t.offset_here()] = last_sib.offset_here();
-					return highest_offset_iter_in_subtree(last_sib);
+					last_children_seen[t.offset_here()] = last_child.offset_here();
+					return highest_offset_iter_in_subtree(last_child);
 				}
 			};
 
@@ -1053,6 +2019,8 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			}
 			
 			parent_of[offset_to_issue] = pos.offset_here();
+			cached_child_offsets.erase(pos.offset_here());
+			cached_named_children.erase(pos.offset_here());
 			
 			return offset_to_issue;
 		}
@@ -1099,6 +2067,53 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			if (!is_real_die_position()) return nullptr;
 			return get_handle().get_name();
 		}
+		opt<string_view>
+		iterator_base::name_view_here() const
+		{
+			if (!is_real_die_position()) return opt<string_view>();
+			return get_root().name_view(*this);
+		}
+		opt<string_view>
+		root_die::name_view(const iterator_base& pos)
+		{
+			if (!pos.is_real_die_position()) return opt<string_view>();
+			Die *p_d = pos.libdwarf_handle();
+			if (!p_d)
+			{
+				/* In-memory, so there are no bytes to point into. */
+				auto name = pos.name_here();
+				if (!name) return opt<string_view>();
+				std::unique_lock<std::mutex> guard(copied_names_lock, std::defer_lock);
+				if (concurrent_readers) guard.lock();
+				return opt<string_view>(string_view(*in_memory_names.insert(*name).first));
+			}
+			Dwarf_Off off = p_d->offset_here();
+			native_reader *p_r = get_native_reader();
+			const native_reader::unit *p_u = p_r ? p_r->unit_containing(off) : nullptr;
+			if (p_u)
+			{
+				native_die d(*p_r, *p_u, p_r->info_at(off));
+				native_value v;
+				if (d && !d.get_value(DW_AT_name, v)) return opt<string_view>();
+				if (d && v.str) return opt<string_view>(string_view(v.str));
+				/* Otherwise it's an index we can't resolve, or a form we
+				 * don't read strings from, so ask libdwarf. */
+			}
+			std::unique_lock<std::mutex> guard(copied_names_lock, std::defer_lock);
+			if (concurrent_readers) guard.lock();
+			auto found = copied_names.find(off);
+			if (found == copied_names.end())
+			{
+				/* Don't hold our lock across libdwarf (which may take
+				 * shared_dbg_lock). If another reader beats us to it,
+				 * emplace() keeps theirs. */
+				if (guard.owns_lock()) guard.unlock();
+				auto name = pos.name_here();
+				if (concurrent_readers) guard.lock();
+				found = copied_names.emplace(off, name).first;
+			}
+			return found->second ? opt<string_view>(string_view(*found->second)) : opt<string_view>();
+		}
 		bool Die::has_attr_here(Dwarf_Half attr) const
 		{
 			Dwarf_Bool returned;
@@ -2136,13 +3151,15 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			// we have to find ourselves. :-(
 			auto t = get_root(opt_r).find(get_offset()).as_a<type_die>();
 			
-			auto name_for_type_die = [](core::iterator_df<core::type_die> t) -> opt<string> {
+			/* Names are shifted in a character at a time, so there's no need
+			 * to copy them. */
+			auto name_for_type_die = [](core::iterator_df<core::type_die> t) -> opt<string_view> {
 				if (t.is_a<dwarf::core::subprogram_die>())
 				{
 					/* When interpreted as types, subprograms don't have names. */
-					return opt<string>();
+					return opt<string_view>();
 				}
-				else return *t.name_here();
+				else return *t.name_view_here();
 			};
 			
 			auto type_summary_code = [](core::iterator_df<core::type_die> t) -> opt<uint32_t> {
@@ -2223,7 +3240,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			else if (concrete_t.is_a<enumeration_type_die>())
 			{
 				// shift in the enumeration name
-				if (concrete_t.name_here())
+				if (concrete_t.name_view_here())
 				{
 					output_word << *name_for_type_die(concrete_t);
 				} else output_word << concrete_t.offset_here();
@@ -2234,7 +3251,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				int last_enum_value = -1;
 				for (auto i_enum = enumerators.first; i_enum != enumerators.second; ++i_enum)
 				{
-					output_word << *i_enum->get_name();
+					output_word << *i_enum.name_view_here();
 					if (i_enum->get_const_value())
 					{
 						last_enum_value = *i_enum->get_const_value();
@@ -2262,7 +3279,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				auto subrange_t = concrete_t.as_a<subrange_type_die>();
 
 				// shift in the name, if any
-				if (concrete_t.name_here())
+				if (concrete_t.name_view_here())
 				{
 					output_word << *name_for_type_die(concrete_t);
 				} else output_word << concrete_t.offset_here();
@@ -2337,7 +3354,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				{
 					summary_code_word_t tmp_output_word;
 					// add in the name only
-					if (target_t.name_here())
+					if (target_t.name_view_here())
 					{
 						tmp_output_word << *name_for_type_die(target_t);
 					} else tmp_output_word << target_t.offset_here();
@@ -2349,7 +3366,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			else if (concrete_t.is_a<with_data_members_die>())
 			{
 				// add in the name
-				if (concrete_t.name_here())
+				if (concrete_t.name_view_here())
 				{
 					output_word << *name_for_type_die(concrete_t);
 				} else output_word << concrete_t.offset_here();
@@ -2451,13 +3468,10 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			/* If the two iterators share a root, check the cache */
 			if (t && &t.root() == &self.root())
 			{
-				auto found_seq = self.root().equal_to.equal_range(t.offset_here());
-				for (auto i_found = found_seq.first; i_found != found_seq.second; ++i_found)
+				bool cached;
+				if (self.root().equal_to.find(make_pair(self.offset_here(), t.offset_here()), cached))
 				{
-					if (i_found->second.first == self.offset_here())
-					{
-						return i_found->second.second;
-					}
+					return cached;
 				}
 			}
 			// we have to find t
@@ -2485,8 +3499,8 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			/* If the two iterators share a root, cache the result */
 			if (t && &t.root() == &self.root())
 			{
-				self.root().equal_to.insert(make_pair(self.offset_here(), make_pair(t.offset_here(), ret)));
-				self.root().equal_to.insert(make_pair(t.offset_here(), make_pair(self.offset_here(), ret)));
+				self.root().equal_to.insert(make_pair(self.offset_here(), t.offset_here()), ret);
+				self.root().equal_to.insert(make_pair(t.offset_here(), self.offset_here()), ret);
 			}
 			
 			return ret;
@@ -2757,7 +3771,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			root_die& r = get_root(opt_r);
 			auto opt_size = get_byte_size(r);
 			if (opt_size) return opt_size;
-			else return r.cu_pos(get_enclosing_cu_offset())->get_address_size(/*opt_r*/);
+			else return r.cu_pos(r.enclosing_cu_offset_of(*this))->get_address_size(/*opt_r*/);
 		}
 /* from spec::array_type_die */
 		opt<Dwarf_Unsigned> array_type_die::element_count(optional_root_arg_decl) const
@@ -2769,7 +3783,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			// we have to find ourselves. :-(
 			auto self = r.find(get_offset());
 			assert(self != iterator_base::END);
-			auto enclosing_cu = r.cu_pos(get_enclosing_cu_offset());
+			auto enclosing_cu = r.cu_pos(r.enclosing_cu_offset_of(*this));
 			auto opt_implicit_lower_bound = enclosing_cu->implicit_array_base();
 			
 			auto subrs = self.children_here().subseq_of<subrange_type_die>();
@@ -2977,8 +3991,10 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			//{
 				// we're either a local or a static -- skip if local
 				root_die& r = get_root(opt_r);
-				auto attrs = copy_attrs(r);
-				if (attrs.find(DW_AT_location) != attrs.end())
+				/* Only the location matters, so don't copy the rest. */
+				attribute_view attrs(*this, r);
+				auto found_location = attrs.find(DW_AT_location);
+				if (found_location != attrs.end())
 				{
 					// HACK: only way to work out whether it's static
 					// is to test for frame-relative addressing in the location
@@ -2989,7 +4005,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 					// break some code on segmented architectures, where even
 					// static storage is recorded in DWARF using 
 					// register-relative addressing....
-					auto loclist = attrs.find(DW_AT_location)->second.get_loclist();
+					auto loclist = found_location.value().get_loclist();
 					
 					// if our loclist is empty, we're probably an optimised-out local,
 					// so return false
@@ -3076,42 +4092,31 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				/* Otherwise we might still be okay. */
 				if (assume_packed_if_no_location)
 				{
-					auto previous_member = parent_first_member;
-					// if there is one member or more before us...
-					if (previous_member.base().base() != it)
+					/* Walk back to the previous non-declaration member or 
+					 * inheritance DIE. There is one, since we're not first. */
+					iterator_df<with_dynamic_location_die> previous_member = r.prev_sibling(it);
+					while (previous_member
+						&& (!(previous_member.is_a<member_die>() || previous_member.is_a<inheritance_die>())
+						|| (previous_member->get_declaration() && *previous_member->get_declaration())))
 					{
-						do
-						{
-							auto next_member = previous_member;
-							// advance to the next non-decl member or inheritance DIE 
-							do
-							{
-								++next_member;
-							} while (next_member.base().base() != it
-								&& (!(next_member.base().base().is_a<member_die>() || next_member.base().base().is_a<inheritance_die>())
-								|| (next_member->get_declaration() && *next_member->get_declaration())));
-							// break if we hit ourselves
-							if (next_member.base().base() == it) break;
-							previous_member = std::move(next_member);
-						} while (true); 
-
-						if (previous_member.base().base()) 
+						previous_member = r.prev_sibling(previous_member);
+					}
+					if (previous_member) 
+					{
+						auto prev_memb_t = previous_member->get_type();
+						if (prev_memb_t)
 						{
-							auto prev_memb_t = previous_member->get_type();
-							if (prev_memb_t)
+							auto opt_prev_byte_size = prev_memb_t->calculate_byte_size();
+							if (opt_prev_byte_size)
 							{
-								auto opt_prev_byte_size = prev_memb_t->calculate_byte_size();
-								if (opt_prev_byte_size)
+								/* Do we have an offset for the previous member? */
+								auto opt_prev_member_offset = previous_member->byte_offset_in_enclosing_type(
+									opt_r, true);
+
+								/* If that succeeded, we can go ahead. */
+								if (opt_prev_member_offset)
 								{
-									/* Do we have an offset for the previous member? */
-									auto opt_prev_member_offset = previous_member->byte_offset_in_enclosing_type(
-										opt_r, true);
-
-									/* If that succeeded, we can go ahead. */
-									if (opt_prev_member_offset)
-									{
-										return opt<Dwarf_Unsigned>(*opt_prev_member_offset + *opt_prev_byte_size);
-									}
+									return opt<Dwarf_Unsigned>(*opt_prev_member_offset + *opt_prev_byte_size);
 								}
 							}
 						}
@@ -3162,7 +4167,9 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			sym_binding_t (*sym_resolve)(const std::string& sym, void *arg), 
 			void *arg /* = 0 */) const
 		{
-			encap::attribute_map attrs = d.copy_attrs(r);
+			/* Most of these attributes we never look at, so view rather 
+			 * than copy them. */
+			attribute_view attrs(*this, r);
 			
 			using namespace boost::icl;
 			auto& right_open = interval<Dwarf_Addr>::right_open;
@@ -3186,8 +4193,8 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 
 				if (found_ranges != attrs.end())
 				{
-					iterator_df<compile_unit_die> i_cu = r.cu_pos(d.enclosing_cu_offset_here());
-					auto rangelist = i_cu->normalize_rangelist(found_ranges->second.get_rangelist());
+					iterator_df<compile_unit_die> i_cu = r.cu_pos(r.enclosing_cu_offset_of(*this));
+					auto rangelist = i_cu->normalize_rangelist(found_ranges.value().get_rangelist());
 					Dwarf_Unsigned cumulative_bytes_seen = 0;
 					for (auto i_r = rangelist.begin(); i_r != rangelist.end(); ++i_r)
 					{
@@ -3219,10 +4226,10 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 							(rangelist.begin())->dwr_addr2
 							)) != retval.end());
 				}
-				else if (found_low_pc != attrs.end() && found_high_pc != attrs.end() && found_high_pc->second.get_form() == encap::attribute_value::ADDR)
+				else if (found_low_pc != attrs.end() && found_high_pc != attrs.end() && found_high_pc.value().get_form() == encap::attribute_value::ADDR)
 				{
-					auto hipc = found_high_pc->second.get_address().addr;
-					auto lopc = found_low_pc->second.get_address().addr;
+					auto hipc = found_high_pc.value().get_address().addr;
+					auto lopc = found_low_pc.value().get_address().addr;
 					if (hipc > lopc)
 					{
 						retval.insert(make_pair(right_open(
@@ -3231,10 +4238,10 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 						), hipc - lopc));
 					} else assert(hipc == lopc);
 				}
-				else if (found_low_pc != attrs.end() && found_high_pc != attrs.end() && found_high_pc->second.get_form() == encap::attribute_value::UNSIGNED)
+				else if (found_low_pc != attrs.end() && found_high_pc != attrs.end() && found_high_pc.value().get_form() == encap::attribute_value::UNSIGNED)
 				{
-					auto lopc = found_low_pc->second.get_address().addr;
-					auto hipc = lopc + found_high_pc->second.get_unsigned();
+					auto lopc = found_low_pc.value().get_address().addr;
+					auto hipc = lopc + found_high_pc.value().get_unsigned();
 					if (hipc > 0) {
 						retval.insert(make_pair(right_open(
 								lopc, 
@@ -3253,7 +4260,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 					auto found_byte_size = attrs.find(DW_AT_byte_size);
 					if (found_byte_size != attrs.end())
 					{
-						opt_byte_size = found_byte_size->second.get_unsigned();
+						opt_byte_size = found_byte_size.value().get_unsigned();
 					}
 					else
 					{	
@@ -3266,7 +4273,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 						if (found_type == attrs.end()) goto out;
 						else
 						{
-							iterator_df<type_die> t = r.find(found_type->second.get_ref().off);
+							iterator_df<type_die> t = r.find(found_type.value().get_ref().off);
 							auto calculated_byte_size = t->calculate_byte_size(r);
 							assert(calculated_byte_size);
 							opt_byte_size = *calculated_byte_size; // assign to *another* opt
@@ -3280,7 +4287,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 						goto out;
 					}
 					
-					auto loclist = found_location->second.get_loclist();
+					auto loclist = found_location.value().get_loclist();
 					std::vector<std::pair<dwarf::encap::loc_expr, Dwarf_Unsigned> > expr_pieces;
 					try
 					{
@@ -3342,11 +4349,11 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 
 					// prefer the DWARF 4 attribute to the MIPS/GNU/... extension
 					if (found_linkage_name != attrs.end()) linkage_name 
-					 = found_linkage_name->second.get_string();
+					 = found_linkage_name.value().get_string();
 					else 
 					{
 						assert(found_mips_linkage_name != attrs.end());
-						linkage_name = found_mips_linkage_name->second.get_string();
+						linkage_name = found_mips_linkage_name.value().get_string();
 					}
 
 					sym_binding_t binding;
@@ -3430,18 +4437,18 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 //         }
 		encap::loclist with_static_location_die::get_static_location(optional_root_arg_decl) const
         {
-        	auto attrs = copy_attrs(get_root(opt_r));
+        	attribute_view attrs(*this, get_root(opt_r));
             if (attrs.find(DW_AT_location) != attrs.end())
             {
-            	return attrs.find(DW_AT_location)->second.get_loclist();
+            	return attrs.get(DW_AT_location).get_loclist();
             }
             else
         	/* This is a dieset-relative address. */
             if (attrs.find(DW_AT_low_pc) != attrs.end() 
             	&& attrs.find(DW_AT_high_pc) != attrs.end())
             {
-				auto low_pc = attrs.find(DW_AT_low_pc)->second.get_address().addr;
-				auto high_pc = attrs.find(DW_AT_high_pc)->second.get_address().addr;
+				auto low_pc = attrs.get(DW_AT_low_pc).get_address().addr;
+				auto high_pc = attrs.get(DW_AT_high_pc).get_address().addr;
 				Dwarf_Unsigned opcodes[] 
 				= { DW_OP_constu, low_pc, 
 					DW_OP_piece, high_pc - low_pc };
@@ -3460,7 +4467,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			else
 			{
 				assert(attrs.find(DW_AT_low_pc) != attrs.end());
-				auto low_pc = attrs.find(DW_AT_low_pc)->second.get_address().addr;
+				auto low_pc = attrs.get(DW_AT_low_pc).get_address().addr;
 				Dwarf_Unsigned opcodes[] 
 				 = { DW_OP_constu, low_pc };
 				/* FIXME: I don't think we should be using the max Dwarf_Addr here -- 
@@ -3693,7 +4700,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
                     Dwarf_Off dieset_relative_ip,
                     dwarf::lib::regs *p_regs) const
         {
-        	auto attrs = copy_attrs(r);
+        	attribute_view attrs(*this, r);
 			if (attrs.find(DW_AT_location) == attrs.end())
 			{
 				cerr << "Warning: " << this->summary() << " has no DW_AT_location; "
@@ -3708,7 +4715,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 			std::cerr << "Calculated that an instance of DIE" << summary()
 				<< " has base addr 0x" << std::hex << base_addr << std::dec;
             assert(attrs.find(DW_AT_type) != attrs.end());
-            auto size = *(attrs.find(DW_AT_type)->second.get_refiter_is_type()->calculate_byte_size(r));
+            auto size = *(attrs.get(DW_AT_type).get_refiter_is_type()->calculate_byte_size(r));
 			std::cerr << " and size " << size
 				<< ", to be tested against absolute addr 0x"
 				<< std::hex << absolute_addr << std::dec << std::endl;
@@ -3759,11 +4766,11 @@ case DW_TAG_ ## name: return &dummy_ ## name;
                     Dwarf_Off dieset_relative_ip,
                     dwarf::lib::regs *p_regs) const
         {
-        	auto attrs = copy_attrs(r);
+        	attribute_view attrs(*this, r);
             auto base_addr = calculate_addr_in_object(
 				object_base_addr, r, dieset_relative_ip, p_regs);
             assert(attrs.find(DW_AT_type) != attrs.end());
-            auto size = *(attrs.find(DW_AT_type)->second.get_refiter_is_type()->calculate_byte_size(r));
+            auto size = *(attrs.get(DW_AT_type).get_refiter_is_type()->calculate_byte_size(r));
             if (absolute_addr >= base_addr
             &&  absolute_addr < base_addr + size)
             {
@@ -3792,11 +4799,11 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				Dwarf_Off dieset_relative_ip,
 				dwarf::lib::regs *p_regs/* = 0*/) const
 		{
-        	auto attrs = copy_attrs(r);
+        	attribute_view attrs(*this, r);
             assert(attrs.find(DW_AT_location) != attrs.end());
 			
 			/* We have to find ourselves. :-( Well, almost -- enclosing CU. */
-			auto found = r.cu_pos(get_enclosing_cu_offset());
+			auto found = r.cu_pos(r.enclosing_cu_offset_of(*this));
 			iterator_df<compile_unit_die> i_cu = found;
 			assert(i_cu != iterator_base::END);
 			Dwarf_Addr dieset_relative_cu_base_ip
@@ -3811,7 +4818,8 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				throw No_entry();
 			}
 			
-			auto& loclist = attrs.find(DW_AT_location)->second.get_loclist();
+			/* Copy it: the value we'd be referring into is a temporary. */
+			encap::loclist loclist = attrs.get(DW_AT_location).get_loclist();
 			auto intervals = loclist.intervals();
 			assert(intervals.begin() != intervals.end());
 			auto first_interval = intervals.begin();
@@ -3842,11 +4850,11 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 				Dwarf_Off dieset_relative_ip,
 				dwarf::lib::regs *p_regs /*= 0*/) const
 		{
-        	auto attrs = copy_attrs(r);
-			iterator_df<compile_unit_die> i_cu = r.cu_pos(get_enclosing_cu_offset());
+        	attribute_view attrs(*this, r);
+			iterator_df<compile_unit_die> i_cu = r.cu_pos(r.enclosing_cu_offset_of(*this));
             assert(attrs.find(DW_AT_data_member_location) != attrs.end());
 			return (Dwarf_Addr) dwarf::lib::evaluator(
-				attrs.find(DW_AT_data_member_location)->second.get_loclist(),
+				attrs.get(DW_AT_data_member_location).get_loclist(),
 				dieset_relative_ip == 0 ? 0 : // if we specify it, needs to be CU-relative
 				 - (i_cu->get_low_pc() ? 
 				 	i_cu->get_low_pc()->addr : (Dwarf_Addr)0),
@@ -3935,9 +4943,12 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 		}
 		iterator_df<type_die> compile_unit_die::implicit_enum_base_type(optional_root_arg_decl) const
 		{
-			if (cached_implicit_enum_base_type) return cached_implicit_enum_base_type; // FIXME: cache "not found" result too
-		
 			root_die& r = get_root(opt_r);
+			/* The cached iterator belongs to whichever thread made it, so 
+			 * concurrent readers (who share CU payloads) can't use it. */
+			bool use_cache = !r.has_concurrent_readers();
+			if (use_cache && cached_implicit_enum_base_type) return cached_implicit_enum_base_type; // FIXME: cache "not found" result too
+
 			switch(get_language(r))
 			{
 				case DW_LANG_C:
@@ -3951,7 +4962,7 @@ case DW_TAG_ ## name: return &dummy_ ## name;
 						auto found = named_child(attempts[i_attempt], opt_r);
 						if (found != iterator_base::END && found.is_a<type_die>())
 						{
-							cached_implicit_enum_base_type = found.as_a<type_die>();
+							if (use_cache) cached_implicit_enum_base_type = found.as_a<type_die>();
 							return found;
 						}
 					}
@@ -0,0 +1,842 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * native.cpp: a zero-copy DIE reader that decodes .debug_info itself,
+ * and lazy attribute views over it
+ *
+ * Copyright (c) 2014, Stephen Kell.
+ */
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gelf.h>
+
+#include "native.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		using std::string;
+		using std::vector;
+		using std::make_pair;
+
+		namespace
+		{
+			/* DWARF 5 and GNU forms. Our dwarf.h may be too old to have them. */
+			enum
+			{
+				FORM_strx = 0x1a,
+				FORM_addrx = 0x1b,
+				FORM_ref_sup4 = 0x1c,
+				FORM_strp_sup = 0x1d,
+				FORM_data16 = 0x1e,
+				FORM_line_strp = 0x1f,
+				FORM_implicit_const = 0x21,
+				FORM_loclistx = 0x22,
+				FORM_rnglistx = 0x23,
+				FORM_ref_sup8 = 0x24,
+				FORM_strx1 = 0x25, FORM_strx2 = 0x26, FORM_strx3 = 0x27, FORM_strx4 = 0x28,
+				FORM_addrx1 = 0x29, FORM_addrx2 = 0x2a, FORM_addrx3 = 0x2b, FORM_addrx4 = 0x2c,
+				FORM_GNU_addr_index = 0x1f01,
+				FORM_GNU_str_index = 0x1f02,
+				FORM_GNU_ref_alt = 0x1f20,
+				FORM_GNU_strp_alt = 0x1f21
+			};
+			enum
+			{
+				AT_str_offsets_base = 0x72,
+				AT_addr_base = 0x73
+			};
+			enum
+			{
+				UT_compile = 1, UT_type, UT_partial, UT_skeleton, UT_split_compile, UT_split_type
+			};
+
+			/* How many bytes a value of this form takes, if we can say without
+			 * looking at it: -1 if it varies, -2 if we don't know the form. */
+			int fixed_form_size(Dwarf_Unsigned form, const native_reader::unit& u)
+			{
+				switch (form)
+				{
+					case DW_FORM_addr: return u.address_size;
+					case DW_FORM_data1: case DW_FORM_ref1: case DW_FORM_flag:
+					case FORM_strx1: case FORM_addrx1:
+						return 1;
+					case DW_FORM_data2: case DW_FORM_ref2: case FORM_strx2: case FORM_addrx2:
+						return 2;
+					case FORM_strx3: case FORM_addrx3:
+						return 3;
+					case DW_FORM_data4: case DW_FORM_ref4: case FORM_strx4: case FORM_addrx4:
+					case FORM_ref_sup4:
+						return 4;
+					case DW_FORM_data8: case DW_FORM_ref8: case DW_FORM_ref_sig8: case FORM_ref_sup8:
+						return 8;
+					case FORM_data16: return 16;
+					case DW_FORM_flag_present: case FORM_implicit_const: return 0;
+					case DW_FORM_strp: case FORM_line_strp: case DW_FORM_sec_offset:
+					case FORM_strp_sup: case FORM_GNU_ref_alt: case FORM_GNU_strp_alt:
+						return u.offset_size;
+					case DW_FORM_ref_addr:
+						return (u.version <= 2) ? u.address_size : u.offset_size;
+					case DW_FORM_string: case DW_FORM_block: case DW_FORM_block1:
+					case DW_FORM_block2: case DW_FORM_block4: case DW_FORM_exprloc:
+					case DW_FORM_sdata: case DW_FORM_udata: case DW_FORM_ref_udata:
+					case FORM_strx: case FORM_addrx: case FORM_loclistx: case FORM_rnglistx:
+					case FORM_GNU_addr_index: case FORM_GNU_str_index: case DW_FORM_indirect:
+						return -1;
+					default: return -2;
+				}
+			}
+
+			bool host_is_little_endian()
+			{
+				const uint16_t one = 1;
+				return *reinterpret_cast<const unsigned char *>(&one) == 1;
+			}
+		}
+
+		native_reader::native_reader(int fd, ::Elf *e)
+		 : ok(false), mapping(MAP_FAILED), mapping_len(0),
+		   info(nullptr), info_len(0), abbrev_data(nullptr), abbrev_len(0),
+		   str(nullptr), str_len(0), line_str(nullptr), line_str_len(0),
+		   str_offsets(nullptr), str_offsets_len(0), addr(nullptr), addr_len(0)
+		{
+			/* Relocatable files' .debug_info needs relocating, which libdwarf
+			 * does and we don't; and we only read our own byte order. */
+			GElf_Ehdr ehdr;
+			if (fd == -1 || !e || !gelf_getehdr(e, &ehdr)) return;
+			if (ehdr.e_type != ET_EXEC && ehdr.e_type != ET_DYN) return;
+			if ((ehdr.e_ident[EI_DATA] == ELFDATA2LSB) != host_is_little_endian()) return;
+
+			struct stat st;
+			if (fstat(fd, &st) != 0) return;
+			mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED) return;
+			mapping_len = st.st_size;
+			const unsigned char *base = static_cast<const unsigned char *>(mapping);
+
+			size_t shstrndx;
+			if (elf_getshdrstrndx(e, &shstrndx) != 0) return;
+			for (Elf_Scn *scn = elf_nextscn(e, nullptr); scn; scn = elf_nextscn(e, scn))
+			{
+				GElf_Shdr shdr;
+				if (!gelf_getshdr(scn, &shdr)) continue;
+				const char *name = elf_strptr(e, shstrndx, shdr.sh_name);
+				if (!name || 0 != strncmp(name, ".debug_", 7)) continue;
+				/* SHF_COMPRESSED is 0x800; older elf.h doesn't have it. */
+				if (shdr.sh_type == SHT_NOBITS || (shdr.sh_flags & 0x800)
+					|| shdr.sh_offset + shdr.sh_size > mapping_len) continue;
+				const unsigned char *data = base + shdr.sh_offset;
+				if (0 == strcmp(name, ".debug_info")) { info = data; info_len = shdr.sh_size; }
+				else if (0 == strcmp(name, ".debug_abbrev")) { abbrev_data = data; abbrev_len = shdr.sh_size; }
+				else if (0 == strcmp(name, ".debug_str"))
+				{ str = reinterpret_cast<const char *>(data); str_len = shdr.sh_size; }
+				else if (0 == strcmp(name, ".debug_line_str"))
+				{ line_str = reinterpret_cast<const char *>(data); line_str_len = shdr.sh_size; }
+				else if (0 == strcmp(name, ".debug_str_offsets")) { str_offsets = data; str_offsets_len = shdr.sh_size; }
+				else if (0 == strcmp(name, ".debug_addr")) { addr = data; addr_len = shdr.sh_size; }
+			}
+			if (!info || !abbrev_data) return;
+
+			/* Read the unit headers, and decode each abbreviation table. */
+			Dwarf_Off off = 0;
+			while (off < info_len)
+			{
+				const unsigned char *p = info + off;
+				const unsigned char *limit = info + info_len;
+				if (limit - p < 11) return;
+				unit u;
+				u.header_offset = off;
+				Dwarf_Unsigned length = read_sized(p, 4); p += 4;
+				u.offset_size = 4;
+				if (length == 0xffffffffu)
+				{
+					if (limit - p < 8) return;
+					length = read_sized(p, 8); p += 8;
+					u.offset_size = 8;
+				}
+				else if (length >= 0xfffffff0u) return; // reserved
+				if (length > (Dwarf_Unsigned) (limit - p)) return;
+				const unsigned char *unit_end = p + length;
+				u.version = read_sized(p, 2); p += 2;
+				if (u.version < 2 || u.version > 5) return;
+				Dwarf_Off abbrev_off;
+				if (u.version >= 5)
+				{
+					unsigned char unit_type = *p++;
+					u.address_size = *p++;
+					abbrev_off = read_sized(p, u.offset_size); p += u.offset_size;
+					switch (unit_type)
+					{
+						case UT_compile: case UT_partial: break;
+						case UT_skeleton: case UT_split_compile: p += 8; break; // DWO id
+						case UT_type: case UT_split_type: p += 8 + u.offset_size; break; // signature, offset
+						default: return;
+					}
+				}
+				else
+				{
+					abbrev_off = read_sized(p, u.offset_size); p += u.offset_size;
+					u.address_size = *p++;
+				}
+				if (p >= unit_end) return;
+				u.die_offset = p - info;
+				u.end_offset = unit_end - info;
+				u.str_offsets_base = 0;
+				u.addr_base = 0;
+
+				auto key = std::make_tuple(abbrev_off, u.address_size, u.offset_size, u.version);
+				auto found = abbrev_tables.find(key);
+				if (found == abbrev_tables.end())
+				{
+					found = abbrev_tables.insert(make_pair(key, abbrev_table())).first;
+					if (!read_abbrevs(abbrev_off, u, found->second)) return;
+				}
+				u.p_abbrevs = &found->second;
+				m_units.push_back(u);
+				off = u.end_offset;
+			}
+
+			/* DWARF 5 string and address indexes are relative to bases that
+			 * the CU DIE gives. */
+			for (auto i_u = m_units.begin(); i_u != m_units.end(); ++i_u)
+			{
+				native_die cu(*this, *i_u, info_at(i_u->die_offset));
+				if (!cu) return;
+				native_value v;
+				try
+				{
+					if (cu.get_value(AT_str_offsets_base, v)) i_u->str_offsets_base = v.u;
+					if (cu.get_value(AT_addr_base, v)) i_u->addr_base = v.u;
+				} catch (Malformed_die&) { return; } // leave it to libdwarf
+			}
+			ok = true;
+		}
+
+		native_reader::~native_reader()
+		{
+			if (mapping != MAP_FAILED) munmap(mapping, mapping_len);
+		}
+
+		bool native_reader::read_abbrevs(Dwarf_Off off, const unit& u, abbrev_table& out)
+		{
+			if (off >= abbrev_len) return false;
+			const unsigned char *p = abbrev_data + off;
+			const unsigned char *limit = abbrev_data + abbrev_len;
+			while (p < limit)
+			{
+				Dwarf_Unsigned code;
+				p = read_uleb128(p, code);
+				if (code == 0) return true;
+				if (p >= limit) return false;
+				abbrev a;
+				Dwarf_Unsigned tag;
+				p = read_uleb128(p, tag);
+				if (p >= limit) return false;
+				a.tag = tag;
+				a.has_children = (*p++ == DW_CHILDREN_yes);
+				a.sibling_index = -1;
+				a.fixed_size = 0;
+				for (;;)
+				{
+					if (p >= limit) return false;
+					Dwarf_Unsigned at, form;
+					p = read_uleb128(p, at);
+					if (p >= limit) return false;
+					p = read_uleb128(p, form);
+					if (at == 0 && form == 0) break;
+					Dwarf_Signed implicit_const = 0;
+					if (form == FORM_implicit_const) p = read_sleb128(p, implicit_const);
+					int size = fixed_form_size(form, u);
+					if (size == -2) return false; // can't skip it, so can't read past it
+					if (size == -1) a.fixed_size = -1;
+					else if (a.fixed_size >= 0) a.fixed_size += size;
+					if (at == DW_AT_sibling) a.sibling_index = a.attrs.size();
+					a.attrs.push_back(at);
+					a.forms.push_back(form);
+					a.implicit_consts.push_back(implicit_const);
+				}
+				if (code == out.dense.size() + 1) out.dense.push_back(std::move(a));
+				else out.sparse.insert(make_pair(code, std::move(a)));
+			}
+			return false;
+		}
+
+		const native_reader::unit *native_reader::unit_containing(Dwarf_Off off) const
+		{
+			auto found = std::upper_bound(m_units.begin(), m_units.end(), off,
+				[](Dwarf_Off o, const unit& u) { return o < u.header_offset; });
+			if (found == m_units.begin()) return nullptr;
+			--found;
+			return (off < found->end_offset) ? &*found : nullptr;
+		}
+
+		const unsigned char *native_reader::read_value(const unit& u, const abbrev& a, unsigned i,
+			const unsigned char *p, native_value& out) const
+		{
+			/* Every read is bounded by the end of the unit, so that a
+			 * malformed DIE can't take us past the end of the section. */
+			const unsigned char *limit = info_at(u.end_offset);
+			auto fits = [&p, limit](Dwarf_Unsigned n) { return p <= limit && n <= (Dwarf_Unsigned) (limit - p); };
+			Dwarf_Unsigned form = a.forms[i];
+			out.u = 0; out.s = 0; out.block = nullptr; out.block_len = 0;
+			out.str = nullptr; out.resolved = true;
+			Dwarf_Unsigned index;
+			for (;;) switch (form)
+			{
+				case DW_FORM_indirect:
+					if (!leb128_fits(p, limit)) goto overrun;
+					p = read_uleb128(p, form);
+					continue;
+				case DW_FORM_addr:
+					if (!fits(u.address_size)) goto overrun;
+					out.u = read_sized(p, u.address_size); p += u.address_size;
+					goto done;
+				case DW_FORM_data1: case DW_FORM_flag:
+					if (!fits(1)) goto overrun;
+					out.u = *p; out.s = (int8_t) *p; p += 1;
+					goto done;
+				case DW_FORM_data2:
+					if (!fits(2)) goto overrun;
+					out.u = read_sized(p, 2); out.s = (int16_t) out.u; p += 2;
+					goto done;
+				case DW_FORM_data4:
+					if (!fits(4)) goto overrun;
+					out.u = read_sized(p, 4); out.s = (int32_t) out.u; p += 4;
+					goto done;
+				case DW_FORM_data8: case DW_FORM_ref_sig8: case FORM_ref_sup8:
+					if (!fits(8)) goto overrun;
+					out.u = read_sized(p, 8); out.s = (int64_t) out.u; p += 8;
+					goto done;
+				case FORM_ref_sup4:
+					if (!fits(4)) goto overrun;
+					out.u = read_sized(p, 4); p += 4;
+					goto done;
+				case FORM_data16:
+					if (!fits(16)) goto overrun;
+					out.block = p; out.block_len = 16; p += 16;
+					goto done;
+				case DW_FORM_sdata:
+					if (!leb128_fits(p, limit)) goto overrun;
+					p = read_sleb128(p, out.s); out.u = out.s;
+					goto done;
+				case DW_FORM_udata:
+					if (!leb128_fits(p, limit)) goto overrun;
+					p = read_uleb128(p, out.u); out.s = out.u;
+					goto done;
+				case FORM_implicit_const:
+					out.s = a.implicit_consts[i]; out.u = out.s;
+					goto done;
+				case DW_FORM_flag_present:
+					out.u = 1;
+					goto done;
+				case DW_FORM_string: {
+					/* Not strlen(): the terminator must be inside the unit. */
+					const void *nul = fits(1) ? memchr(p, '\0', limit - p) : nullptr;
+					if (!nul) goto overrun;
+					out.str = reinterpret_cast<const char *>(p);
+					p = static_cast<const unsigned char *>(nul) + 1;
+					goto done;
+				}
+				case DW_FORM_strp:
+					if (!fits(u.offset_size)) goto overrun;
+					out.u = read_sized(p, u.offset_size); p += u.offset_size;
+					out.str = string_at(str, str_len, out.u);
+					goto done;
+				case FORM_line_strp:
+					if (!fits(u.offset_size)) goto overrun;
+					out.u = read_sized(p, u.offset_size); p += u.offset_size;
+					out.str = string_at(line_str, line_str_len, out.u);
+					goto done;
+				case FORM_strx: case FORM_GNU_str_index:
+					if (!leb128_fits(p, limit)) goto overrun;
+					p = read_uleb128(p, index);
+					goto str_index;
+				case FORM_strx1: case FORM_strx2: case FORM_strx3: case FORM_strx4: {
+					unsigned size = form - FORM_strx1 + 1;
+					if (!fits(size)) goto overrun;
+					index = read_sized(p, size); p += size;
+				} // fall through
+				str_index: {
+					out.u = index;
+					Dwarf_Unsigned entry = u.str_offsets_base + index * u.offset_size;
+					if (u.str_offsets_base != 0 && entry + u.offset_size <= str_offsets_len)
+					{
+						out.str = string_at(str, str_len, read_sized(str_offsets + entry, u.offset_size));
+					}
+					out.resolved = (out.str != nullptr);
+					goto done;
+				}
+				case FORM_addrx: case FORM_GNU_addr_index:
+					if (!leb128_fits(p, limit)) goto overrun;
+					p = read_uleb128(p, index);
+					goto addr_index;
+				case FORM_addrx1: case FORM_addrx2: case FORM_addrx3: case FORM_addrx4: {
+					unsigned size = form - FORM_addrx1 + 1;
+					if (!fits(size)) goto overrun;
+					index = read_sized(p, size); p += size;
+				} // fall through
+				addr_index: {
+					Dwarf_Unsigned entry = u.addr_base + index * u.address_size;
+					out.resolved = (u.addr_base != 0 && entry + u.address_size <= addr_len);
+					out.u = out.resolved ? read_sized(addr + entry, u.address_size) : index;
+					goto done;
+				}
+				case FORM_loclistx: case FORM_rnglistx:
+					if (!leb128_fits(p, limit)) goto overrun;
+					p = read_uleb128(p, out.u);
+					out.resolved = false;
+					goto done;
+				case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4: case DW_FORM_ref8: {
+					unsigned size = fixed_form_size(form, u);
+					if (!fits(size)) goto overrun;
+					out.u = u.header_offset + read_sized(p, size); p += size;
+					goto done;
+				}
+				case DW_FORM_ref_udata:
+					if (!leb128_fits(p, limit)) goto overrun;
+					p = read_uleb128(p, out.u); out.u += u.header_offset;
+					goto done;
+				case DW_FORM_ref_addr: {
+					unsigned size = (u.version <= 2) ? u.address_size : u.offset_size;
+					if (!fits(size)) goto overrun;
+					out.u = read_sized(p, size); p += size;
+					goto done;
+				}
+				case DW_FORM_sec_offset: case FORM_strp_sup: case FORM_GNU_ref_alt: case FORM_GNU_strp_alt:
+					if (!fits(u.offset_size)) goto overrun;
+					out.u = read_sized(p, u.offset_size); p += u.offset_size;
+					goto done;
+				case DW_FORM_block1:
+					if (!fits(1)) goto overrun;
+					out.block_len = *p; p += 1;
+					goto block;
+				case DW_FORM_block2:
+					if (!fits(2)) goto overrun;
+					out.block_len = read_sized(p, 2); p += 2;
+					goto block;
+				case DW_FORM_block4:
+					if (!fits(4)) goto overrun;
+					out.block_len = read_sized(p, 4); p += 4;
+					goto block;
+				case DW_FORM_block: case DW_FORM_exprloc:
+					if (!leb128_fits(p, limit)) goto overrun;
+					p = read_uleb128(p, out.block_len);
+				block:
+					if (!fits(out.block_len)) goto overrun;
+					out.block = p; p += out.block_len;
+					goto done;
+				default:
+					/* read_abbrevs() refused anything else, but DW_FORM_indirect
+					 * can still get us here. We can't go on. */
+					throw Not_supported("unknown attribute form");
+			}
+		done:
+			out.form = form;
+			return p;
+		overrun:
+			throw Malformed_die(offset_of(p));
+		}
+
+		native_die native_die::first_child() const
+		{
+			if (!p_abbrev->has_children) return native_die();
+			return native_die(*p_reader, *p_unit, end());
+		}
+
+		native_die native_die::next_sibling() const
+		{
+			/* DW_AT_sibling lets us hop straight over our children. */
+			if (p_abbrev->sibling_index != -1)
+			{
+				native_value v;
+				const unsigned char *p = attrs;
+				for (int i = 0; i <= p_abbrev->sibling_index; ++i)
+				{
+					p = p_reader->read_value(*p_unit, *p_abbrev, i, p, v);
+				}
+				if (v.u > off && v.u < p_unit->end_offset)
+				{
+					return native_die(*p_reader, *p_unit, p_reader->info_at(v.u));
+				}
+			}
+			const unsigned char *p = end();
+			if (p_abbrev->has_children)
+			{
+				/* Walk over the children, counting the null entries. */
+				const unsigned char *limit = p_reader->info_at(p_unit->end_offset);
+				unsigned levels = 1;
+				while (levels > 0 && p < limit)
+				{
+					if (*p == 0) { ++p; --levels; continue; }
+					native_die d(*p_reader, *p_unit, p);
+					if (!d) return native_die(); // bad abbreviation code
+					p = d.end();
+					if (d.has_children()) ++levels;
+				}
+			}
+			return native_die(*p_reader, *p_unit, p);
+		}
+
+		bool native_die::get_value(Dwarf_Half attr, native_value& out) const
+		{
+			int idx = find_attr(attr);
+			if (idx == -1) return false;
+			const unsigned char *p = attrs;
+			for (int i = 0; i <= idx; ++i) p = p_reader->read_value(*p_unit, *p_abbrev, i, p, out);
+			return true;
+		}
+
+		const char *native_die::get_raw_name() const
+		{
+			native_value v;
+			if (!get_value(DW_AT_name, v)) return nullptr;
+			return v.str;
+		}
+
+		namespace
+		{
+			/* Could attribute_value's libdwarf-based constructor get this
+			 * value without help? If so, we do the same thing natively;
+			 * we take exactly the forms that libdwarf accepts for each class,
+			 * so that we agree with it. */
+			bool natively_decodable(int cls, const native_value& v)
+			{
+				const Dwarf_Half f = v.form;
+				bool is_data = (f == DW_FORM_data1 || f == DW_FORM_data2
+					|| f == DW_FORM_data4 || f == DW_FORM_data8);
+				switch (cls & ~::dwarf::spec::interp::FLAGS)
+				{
+					case ::dwarf::spec::interp::string:
+						return v.str != nullptr;
+					case ::dwarf::spec::interp::flag:
+						return f == DW_FORM_flag || f == DW_FORM_flag_present;
+					case ::dwarf::spec::interp::address:
+						return (f == DW_FORM_addr || f == FORM_addrx || f == FORM_GNU_addr_index
+							|| (f >= FORM_addrx1 && f <= FORM_addrx4)) && v.resolved;
+					case ::dwarf::spec::interp::block:
+						return f == DW_FORM_block || f == DW_FORM_block1
+							|| f == DW_FORM_block2 || f == DW_FORM_block4;
+					case ::dwarf::spec::interp::reference:
+						return f == DW_FORM_ref1 || f == DW_FORM_ref2 || f == DW_FORM_ref4
+							|| f == DW_FORM_ref8 || f == DW_FORM_ref_udata || f == DW_FORM_ref_addr;
+					case ::dwarf::spec::interp::constant:
+						return is_data || f == DW_FORM_sdata || f == DW_FORM_udata
+							|| f == DW_FORM_sec_offset;
+					case ::dwarf::spec::interp::constant_to_make_location_expr:
+					case ::dwarf::spec::interp::macptr:
+						return is_data || f == DW_FORM_udata;
+					case ::dwarf::spec::interp::lineptr:
+						return f == DW_FORM_sec_offset || f == DW_FORM_data4 || f == DW_FORM_data8;
+					default:
+						/* Location and range lists, expressions, and anything
+						 * we don't expect: ask libdwarf. */
+						return false;
+				}
+			}
+		}
+
+		encap::attribute_map native_die::copy_attrs(opt<root_die&> opt_r) const
+		{
+			assert(opt_r); // we need it for references, if nothing else
+			root_die& r = *opt_r;
+			spec& s = get_spec(r);
+			encap::attribute_map m;
+			unique_ptr<Die> p_d; // made only if we need libdwarf's help
+			const unsigned char *p = attrs;
+			for (unsigned i = 0; i < p_abbrev->attrs.size(); ++i)
+			{
+				native_value v;
+				p = p_reader->read_value(*p_unit, *p_abbrev, i, p, v);
+				Dwarf_Half attr = p_abbrev->attrs[i];
+				int cls = s.get_interp(attr, v.form);
+				if (natively_decodable(cls, v))
+				{
+					m.insert(make_pair(attr, encap::attribute_value(*this, attr, v, cls, r)));
+					continue;
+				}
+				if (!p_d) p_d = unique_ptr<Die>(new Die(r, off));
+				Attribute a(*p_d, attr);
+				m.insert(make_pair(attr, encap::attribute_value(a, *p_d, r)));
+			}
+			return m;
+		}
+
+		encap::attribute_value native_die::get_attr_value(unsigned i, root_die& r) const
+		{
+			assert(i < p_abbrev->attrs.size());
+			native_value v;
+			const unsigned char *p = attrs;
+			for (unsigned j = 0; j <= i; ++j) p = p_reader->read_value(*p_unit, *p_abbrev, j, p, v);
+			Dwarf_Half attr = p_abbrev->attrs[i];
+			int cls = get_spec(r).get_interp(attr, v.form);
+			if (natively_decodable(cls, v)) return encap::attribute_value(*this, attr, v, cls, r);
+			/* As in copy_attrs(). */
+			Die d(r, off);
+			Attribute a(d, attr);
+			return encap::attribute_value(a, d, r);
+		}
+
+		attribute_view::attribute_view(const iterator_base& i, root_die& r)
+		 : p_root(&r), p_d(nullptr), p_lock(nullptr), p_in_memory(nullptr), have_listed(false)
+		{
+			if (!i.is_real_die_position()) return; // no attributes
+			Die *p_handle = i.libdwarf_handle();
+			if (p_handle) init_from_handle(*p_handle);
+			else p_in_memory = &dynamic_cast<const in_memory_abstract_die&>(i.dereference()).m_attrs;
+		}
+
+		attribute_view::attribute_view(const basic_die& d, root_die& r)
+		 : p_root(&r), p_d(nullptr), p_lock(nullptr), p_in_memory(nullptr), have_listed(false)
+		{
+			if (d.d.handle) init_from_handle(d.d);
+			else p_in_memory = &dynamic_cast<const in_memory_abstract_die&>(d).m_attrs;
+		}
+
+		attribute_view::attribute_view(const native_die& d, root_die& r)
+		 : p_root(&r), native(d), p_d(nullptr), p_lock(nullptr), p_in_memory(nullptr), have_listed(false)
+		{}
+
+		void attribute_view::init_from_handle(const Die& d)
+		{
+			Dwarf_Off off = d.offset_here();
+			native_reader *p_r = p_root->get_native_reader();
+			const native_reader::unit *p_u = p_r ? p_r->unit_containing(off) : nullptr;
+			if (p_u) native = native_die(*p_r, *p_u, p_r->info_at(off));
+			if (!native)
+			{
+				p_d = &d;
+				p_lock = p_root->shared_lock_for(d.get_dbg());
+			}
+		}
+
+		const vector<Dwarf_Half>& attribute_view::libdwarf_attrs() const
+		{
+			if (!have_listed)
+			{
+				std::unique_lock<std::recursive_mutex> guard;
+				if (p_lock) guard = std::unique_lock<std::recursive_mutex>(*p_lock);
+				AttributeList l(*p_d);
+				for (auto i = l.copied_list.begin(); i != l.copied_list.end(); ++i)
+				{
+					listed.push_back(i->attr_here());
+				}
+				have_listed = true;
+			}
+			return listed;
+		}
+
+		unsigned attribute_view::size() const
+		{
+			if (native) return native.p_abbrev->attrs.size();
+			if (p_d) return libdwarf_attrs().size();
+			if (p_in_memory) return p_in_memory->size();
+			return 0;
+		}
+
+		Dwarf_Half attribute_view::attr_at(unsigned idx) const
+		{
+			assert(idx < size());
+			if (native) return native.p_abbrev->attrs[idx];
+			if (p_d) return libdwarf_attrs()[idx];
+			return std::next(p_in_memory->begin(), idx)->first;
+		}
+
+		encap::attribute_value attribute_view::value_at(unsigned idx) const
+		{
+			assert(idx < size());
+			if (native) return native.get_attr_value(idx, *p_root);
+			if (p_d) return get(libdwarf_attrs()[idx]);
+			return std::next(p_in_memory->begin(), idx)->second;
+		}
+
+		attribute_view::const_iterator attribute_view::begin() const
+		{
+			if (size() == 0) return end();
+			return const_iterator { this, attr_at(0), 0 };
+		}
+
+		attribute_view::const_iterator& attribute_view::const_iterator::operator++()
+		{
+			assert(m_attr != 0);
+			unsigned next = idx + 1;
+			if (idx == NOT_LISTED)
+			{
+				const vector<Dwarf_Half>& l = p_view->libdwarf_attrs();
+				next = std::find(l.begin(), l.end(), m_attr) - l.begin() + 1;
+			}
+			if (next < p_view->size()) { idx = next; m_attr = p_view->attr_at(next); }
+			else *this = p_view->end();
+			return *this;
+		}
+
+		attribute_view::const_iterator attribute_view::find(Dwarf_Half attr) const
+		{
+			if (native)
+			{
+				int idx = native.find_attr(attr);
+				return (idx == -1) ? end() : const_iterator { this, attr, (unsigned) idx };
+			}
+			if (p_d)
+			{
+				/* Don't make libdwarf list them all just to give us an index. */
+				return p_d->has_attr_here(attr) ? const_iterator { this, attr, const_iterator::NOT_LISTED }
+					: end();
+			}
+			if (p_in_memory)
+			{
+				auto found = p_in_memory->find(attr);
+				if (found == p_in_memory->end()) return end();
+				return const_iterator { this, attr, (unsigned) std::distance(p_in_memory->begin(), found) };
+			}
+			return end();
+		}
+
+		bool attribute_view::has(Dwarf_Half attr) const
+		{
+			if (native) return native.find_attr(attr) != -1;
+			if (p_d) return p_d->has_attr_here(attr);
+			if (p_in_memory) return p_in_memory->find(attr) != p_in_memory->end();
+			return false;
+		}
+
+		encap::attribute_value attribute_view::get(Dwarf_Half attr) const
+		{
+			if (native)
+			{
+				int idx = native.find_attr(attr);
+				return (idx == -1) ? encap::attribute_value() : native.get_attr_value(idx, *p_root);
+			}
+			if (p_d)
+			{
+				if (!p_d->has_attr_here(attr)) return encap::attribute_value();
+				std::unique_lock<std::recursive_mutex> guard;
+				if (p_lock) guard = std::unique_lock<std::recursive_mutex>(*p_lock);
+				Attribute a(*p_d, attr);
+				return encap::attribute_value(a, *p_d, *p_root);
+			}
+			if (p_in_memory)
+			{
+				auto found = p_in_memory->find(attr);
+				if (found != p_in_memory->end()) return found->second;
+			}
+			return encap::attribute_value();
+		}
+
+		native_iterator_df native_iterator_df::begin(const native_reader& r)
+		{
+			if (r.units().empty()) return native_iterator_df();
+			const native_reader::unit& u = r.units().front();
+			return native_iterator_df(native_die(r, u, r.info_at(u.die_offset)), 1);
+		}
+
+		native_iterator_df& native_iterator_df::operator++()
+		{
+			return advance_to(cur.end(), m_depth + (cur.has_children() ? 1 : 0));
+		}
+
+		native_iterator_df& native_iterator_df::increment_skipping_subtree()
+		{
+			if (!cur.has_children()) return ++*this;
+			/* Skipping a CU's children is just moving on to the next unit. */
+			if (m_depth == 1) return advance_to(cur.end(), 1);
+			native_die sib = cur.next_sibling();
+			/* A bad abbreviation among the children ends the walk, just as
+			 * it would if we had walked through them. */
+			if (!sib.p_reader) { *this = native_iterator_df(); return *this; }
+			/* sib may be the null entry closing our list, or the unit's end;
+			 * advance_to() copes with either. */
+			return advance_to(cur.p_reader->info_at(sib.off), m_depth);
+		}
+
+		native_iterator_df& native_iterator_df::advance_to(const unsigned char *p, unsigned depth)
+		{
+			const native_reader& r = *cur.p_reader;
+			const native_reader::unit *p_u = cur.p_unit;
+			const unsigned char *limit = r.info_at(p_u->end_offset);
+			/* Each null entry closes a list of children. Once we're back at
+			 * CU level, the unit is done (whatever padding follows). */
+			while (depth > 1 && p < limit && *p == 0) { ++p; --depth; }
+			if (depth > 1 && p < limit)
+			{
+				cur = native_die(r, *p_u, p);
+				m_depth = depth;
+				return *this;
+			}
+			const native_reader::unit *p_next = p_u + 1;
+			if (p_next == r.units().data() + r.units().size())
+			{
+				*this = native_iterator_df();
+				return *this;
+			}
+			cur = native_die(r, *p_next, r.info_at(p_next->die_offset));
+			m_depth = 1;
+			return *this;
+		}
+	}
+
+	namespace encap
+	{
+		attribute_value::attribute_value(const core::native_die& d, Dwarf_Half attr,
+			const core::native_value& v, int cls, root_die& r)
+			: p_ds(nullptr), orig_form(v.form)
+		{
+			/* This follows the libdwarf-based constructor (in attr.cpp), for
+			 * the cases that core::native_die::copy_attrs() lets through. */
+			dwarf::spec::abstract_def& spec = d.get_spec(r);
+			switch (cls & ~spec::interp::FLAGS)
+			{
+				case spec::interp::string:
+					this->f = STRING;
+					this->v_string = new string(v.str);
+					break;
+				case spec::interp::flag:
+					this->f = FLAG;
+					this->v_flag = v.u;
+					break;
+				case spec::interp::address:
+					this->f = ADDR;
+					this->v_addr.addr = v.u;
+					break;
+				case spec::interp::block:
+					this->f = BLOCK;
+					this->v_block = new vector<unsigned char>(v.block, v.block + v.block_len);
+					break;
+				case spec::interp::reference:
+					this->f = REF;
+					this->v_ref = new weak_ref(r, v.u, true, d.get_offset(), attr);
+					break;
+				case spec::interp::constant:
+					if (v.form == DW_FORM_sdata
+						|| (v.form != DW_FORM_udata && v.form != DW_FORM_sec_offset
+							&& (cls & spec::interp::SIGNED)))
+					{
+						this->f = SIGNED;
+						this->v_s = v.s;
+					}
+					else
+					{
+						this->f = UNSIGNED;
+						this->v_u = v.u;
+					}
+					break;
+				case spec::interp::constant_to_make_location_expr:
+					this->f = LOCLIST;
+					this->v_loclist = new loclist(loc_expr((Dwarf_Unsigned[]) { DW_OP_plus_uconst, v.u }, 0, 0, spec));
+					break;
+				case spec::interp::lineptr:
+				case spec::interp::macptr:
+					this->f = UNSIGNED;
+					this->v_u = v.u;
+					break;
+				default:
+					assert(false);
+					this->f = UNRECOG;
+			}
+		}
+	}
+}
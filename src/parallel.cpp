@@ -0,0 +1,226 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * parallel.cpp: whole-tree traversal on a pool of threads
+ *
+ * Copyright (c) 2014, Stephen Kell.
+ */
+
+#include <deque>
+#include <exception>
+#include "lib.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		using std::vector;
+		using std::unique_ptr;
+
+		namespace
+		{
+			/* Units much smaller than this cost more to hand out than to do. */
+			const unsigned MIN_UNIT_DIES = 1024;
+			/* Aim for this many units per worker, so that stealing can even
+			 * out the CUs' (very uneven) sizes. */
+			const unsigned UNITS_PER_WORKER = 8;
+
+			typedef cu_topology::ordinal_t ordinal_t;
+
+			/* Cut the subtree [o, end) into runs of at most "target" DIEs
+			 * where we can. A run is o itself plus some of its children's
+			 * subtrees, or just some of o's children's subtrees; a child
+			 * subtree that's too big on its own gets cut in the same way.
+			 * Runs come out in depth-first order. */
+			void split_subtree(const cu_topology& t, ordinal_t o, ordinal_t end,
+				unsigned target, vector<std::pair<ordinal_t, ordinal_t> >& out)
+			{
+				if (end - o <= target) { out.push_back(std::make_pair(o, end)); return; }
+				ordinal_t run_begin = o;
+				for (ordinal_t c = t.first_child[o]; c != cu_topology::NONE; c = t.next_sibling[c])
+				{
+					ordinal_t c_end = (t.next_sibling[c] != cu_topology::NONE) ? t.next_sibling[c] : end;
+					if (c_end - c > target)
+					{
+						if (run_begin < c) out.push_back(std::make_pair(run_begin, c));
+						split_subtree(t, c, c_end, target, out);
+						run_begin = c_end;
+					}
+					else if (c_end - run_begin > target)
+					{
+						if (run_begin < c) out.push_back(std::make_pair(run_begin, c));
+						run_begin = c;
+					}
+				}
+				if (run_begin < end) out.push_back(std::make_pair(run_begin, end));
+			}
+		}
+
+		vector<root_die::traversal_unit> root_die::prepare_parallel(bool split_cus, unsigned& nthreads,
+			concurrent_section& section)
+		{
+			if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+			if (nthreads > 1 && !concurrent_readers)
+			{
+				if (enable_concurrent_readers(nthreads)) section.p_entered = this;
+				else nthreads = 1;
+			}
+
+			vector<Dwarf_Off> cu_offsets;
+			auto cus = children();
+			for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu)
+			{
+				cu_offsets.push_back(i_cu.base().base().offset_here());
+			}
+
+			vector<traversal_unit> units;
+			if (!split_cus || nthreads == 1)
+			{
+				for (auto i_cu = cu_offsets.begin(); i_cu != cu_offsets.end(); ++i_cu)
+				{
+					const cu_topology *p_t = split_cus ? topology_for_cu(*i_cu) : nullptr;
+					units.push_back(traversal_unit { *i_cu, 0,
+						p_t ? p_t->size() : cu_topology::NONE });
+				}
+				return units;
+			}
+
+			/* We're in concurrent-reader mode, so the topologies are built. */
+			vector<const cu_topology *> topologies;
+			unsigned long total = 0;
+			for (auto i_cu = cu_offsets.begin(); i_cu != cu_offsets.end(); ++i_cu)
+			{
+				const cu_topology *p_t = topology_for_cu(*i_cu);
+				topologies.push_back(p_t);
+				if (p_t) total += p_t->size();
+			}
+			unsigned target = std::max<unsigned long>(MIN_UNIT_DIES,
+				total / (nthreads * UNITS_PER_WORKER));
+			vector<std::pair<ordinal_t, ordinal_t> > runs;
+			for (unsigned i = 0; i < cu_offsets.size(); ++i)
+			{
+				const cu_topology *p_t = topologies[i];
+				if (!p_t)
+				{
+					units.push_back(traversal_unit { cu_offsets[i], 0, cu_topology::NONE });
+					continue;
+				}
+				runs.clear();
+				split_subtree(*p_t, 0, p_t->size(), target, runs);
+				for (auto i_r = runs.begin(); i_r != runs.end(); ++i_r)
+				{
+					units.push_back(traversal_unit { cu_offsets[i], i_r->first, i_r->second });
+				}
+			}
+			return units;
+		}
+
+		void root_die::run_work_stealing(unsigned nunits, std::function<void(unsigned, unsigned)> fn,
+			unsigned nthreads)
+		{
+			if (nunits == 0) return;
+			if (nthreads > nunits) nthreads = nunits;
+
+			/* Deal out contiguous blocks, so that a worker's own units are
+			 * neighbours in the file. Owners take from the front, thieves
+			 * from the back. */
+			struct work_queue
+			{
+				std::mutex lock;
+				std::deque<unsigned> units;
+			};
+			unique_ptr<work_queue[]> queues(new work_queue[nthreads]);
+			for (unsigned i = 0; i < nunits; ++i)
+			{
+				queues[(unsigned long) i * nthreads / nunits].units.push_back(i);
+			}
+			auto take = [&queues, nthreads](unsigned me, unsigned& out) -> bool {
+				for (unsigned k = 0; k < nthreads; ++k)
+				{
+					work_queue& q = queues[(me + k) % nthreads];
+					std::lock_guard<std::mutex> guard(q.lock);
+					if (q.units.empty()) continue;
+					if (k == 0) { out = q.units.front(); q.units.pop_front(); }
+					else { out = q.units.back(); q.units.pop_back(); }
+					return true;
+				}
+				/* Nobody makes new units, so once every queue is empty,
+				 * we're done. */
+				return false;
+			};
+
+			std::atomic<bool> failed(false);
+			vector<std::exception_ptr> errors(nthreads);
+			auto work = [&](unsigned me) {
+				try
+				{
+					unsigned i;
+					while (!failed && take(me, i)) fn(i, me);
+				}
+				catch (...) { errors[me] = std::current_exception(); failed = true; }
+				/* Workers' iterators are all gone by now, so give back their
+				 * reader Debugs, if they had any. The calling thread keeps 
+				 * its own. */
+				if (me != 0) release_this_reader();
+			};
+			vector<std::thread> workers;
+			for (unsigned i = 1; i < nthreads; ++i) workers.push_back(std::thread(work, i));
+			work(0); // the calling thread is worker 0
+			for (auto i_w = workers.begin(); i_w != workers.end(); ++i_w) i_w->join();
+			for (auto i_e = errors.begin(); i_e != errors.end(); ++i_e)
+			{
+				if (*i_e) std::rethrow_exception(*i_e);
+			}
+		}
+
+		void root_die::walk_unit(const traversal_unit& u,
+			const std::function<bool(const iterator_base&)>& pred,
+			const std::function<void(const iterator_base&)>& fn)
+		{
+			if (u.end == cu_topology::NONE)
+			{
+				/* No topology, so walk the CU with a plain iterator. */
+				for (iterator_df<> i = pos(u.cu_offset, 1); i != iterator_base::END; ++i)
+				{
+					if (i.offset_here() != u.cu_offset && i.depth() <= 1) break;
+					if (pred(i)) fn(i);
+				}
+				return;
+			}
+			/* Depth-first order is ordinal order, so just count along. Going
+			 * by offset, rather than moving an iterator, means we never climb
+			 * out of the unit. */
+			const cu_topology *p_t = topology_for_cu(u.cu_offset);
+			assert(p_t);
+			const cu_topology& t = *p_t;
+			for (ordinal_t o = u.begin; o < u.end; ++o)
+			{
+				Dwarf_Off parent_off = (t.parent[o] == cu_topology::NONE) ? 0UL : t.offsets[t.parent[o]];
+				iterator_base i = pos(t.offsets[o], t.depth_of(o), parent_off);
+				if (pred(i)) fn(i);
+			}
+		}
+
+		void root_die::parallel_for_each_cu(
+			std::function<void(const iterator_df<compile_unit_die>&)> fn,
+			unsigned nthreads)
+		{
+			concurrent_section section;
+			vector<traversal_unit> units = prepare_parallel(false, nthreads, section);
+			run_work_stealing(units.size(), [this, &units, &fn](unsigned i, unsigned) {
+				fn(cu_pos(units[i].cu_offset));
+			}, nthreads);
+		}
+
+		void root_die::parallel_for_each_die(
+			std::function<bool(const iterator_base&)> pred,
+			std::function<void(const iterator_base&)> fn,
+			unsigned nthreads)
+		{
+			concurrent_section section;
+			vector<traversal_unit> units = prepare_parallel(true, nthreads, section);
+			run_work_stealing(units.size(), [this, &units, &pred, &fn](unsigned i, unsigned) {
+				walk_unit(units[i], pred, fn);
+			}, nthreads);
+		}
+	}
+}
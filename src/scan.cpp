@@ -0,0 +1,249 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * scan.cpp: columnar export of a few fields of every DIE
+ *
+ * Copyright (c) 2014, Stephen Kell.
+ */
+
+#include <unordered_map>
+#include "lib.hpp"
+#include "native.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		using std::vector;
+		using std::pair;
+		using std::make_pair;
+
+		const uint32_t scan_table::NO_NAME;
+		const Dwarf_Unsigned scan_table::NO_BYTE_SIZE;
+
+		namespace
+		{
+			/* DWARF 5; our dwarf.h may be too old to have it. */
+			const Dwarf_Half FORM_implicit_const = 0x21;
+
+			struct view_hash
+			{
+				size_t operator()(const string_view& v) const
+				{
+					/* FNV-1a */
+					size_t h = 2166136261u;
+					for (auto i = v.begin(); i != v.end(); ++i)
+					{
+						h ^= (unsigned char) *i;
+						h *= 16777619u;
+					}
+					return h;
+				}
+			};
+			typedef std::unordered_map<string_view, uint32_t, view_hash> name_ids;
+
+			uint32_t intern(scan_table& t, name_ids& ids, const string_view& name)
+			{
+				auto found = ids.find(name);
+				if (found != ids.end()) return found->second;
+				uint32_t id = t.names.size();
+				t.names.push_back(name);
+				ids.insert(make_pair(name, id));
+				return id;
+			}
+
+			/* Append from's rows to into's, renumbering from's names. ids
+			 * must hold into's names. */
+			void merge(scan_table& into, name_ids& ids, const scan_table& from)
+			{
+				assert(into.columns == from.columns);
+				into.offset.insert(into.offset.end(), from.offset.begin(), from.offset.end());
+				into.parent.insert(into.parent.end(), from.parent.begin(), from.parent.end());
+				into.tag.insert(into.tag.end(), from.tag.begin(), from.tag.end());
+				into.depth.insert(into.depth.end(), from.depth.begin(), from.depth.end());
+				into.type.insert(into.type.end(), from.type.begin(), from.type.end());
+				into.byte_size.insert(into.byte_size.end(), from.byte_size.begin(), from.byte_size.end());
+				if (into.columns & scan_table::NAME)
+				{
+					vector<uint32_t> renumbered(from.names.size());
+					for (unsigned i = 0; i < from.names.size(); ++i)
+					{
+						renumbered[i] = intern(into, ids, from.names[i]);
+					}
+					for (auto i_n = from.name.begin(); i_n != from.name.end(); ++i_n)
+					{
+						into.name.push_back((*i_n == scan_table::NO_NAME) ? *i_n : renumbered[*i_n]);
+					}
+				}
+				into.rows += from.rows;
+			}
+
+			/* One unit of work's rows. Each DIE gets a row if pred accepts
+			 * it, but we see every DIE, so that we know everyone's parent. */
+			struct unit_scan
+			{
+				scan_table t;
+				name_ids ids;
+				vector<Dwarf_Off> parents; // parents[d - 1] is the latest DIE at depth d
+				/* Rows whose names the native reader couldn't find. */
+				vector< pair<unsigned long, Dwarf_Off> > unresolved_names;
+
+				explicit unit_scan(unsigned columns) : t(columns) {}
+
+				/* Returns the parent's offset. */
+				Dwarf_Off saw(Dwarf_Off off, unsigned depth)
+				{
+					parents.resize(depth);
+					parents[depth - 1] = off;
+					return (depth > 1) ? parents[depth - 2] : 0UL;
+				}
+				void add(Dwarf_Off off, Dwarf_Off parent, Dwarf_Half tag, unsigned depth,
+					opt<string_view> name, Dwarf_Off type, Dwarf_Unsigned byte_size)
+				{
+					unsigned c = t.columns;
+					if (c & scan_table::OFFSET) t.offset.push_back(off);
+					if (c & scan_table::PARENT) t.parent.push_back(parent);
+					if (c & scan_table::TAG) t.tag.push_back(tag);
+					if (c & scan_table::DEPTH) t.depth.push_back(depth);
+					if (c & scan_table::NAME) t.name.push_back(name ? intern(t, ids, *name) : scan_table::NO_NAME);
+					if (c & scan_table::TYPE) t.type.push_back(type);
+					if (c & scan_table::BYTE_SIZE) t.byte_size.push_back(byte_size);
+					++t.rows;
+				}
+			};
+
+			void scan_native_unit(const native_reader& r, const native_reader::unit& u,
+				const std::function<bool(Dwarf_Off, Dwarf_Half, unsigned)>& pred,
+				unit_scan& out)
+			{
+				const unsigned c = out.t.columns;
+				for (native_iterator_df i(native_die(r, u, r.info_at(u.die_offset)), 1);
+					!i.is_end() && i->p_unit == &u; ++i)
+				{
+					const native_die& d = *i;
+					Dwarf_Off parent = out.saw(d.off, i.depth());
+					Dwarf_Half tag = d.get_tag();
+					if (pred && !pred(d.off, tag, i.depth())) continue;
+
+					native_value v;
+					opt<string_view> name;
+					if ((c & scan_table::NAME) && d.get_value(DW_AT_name, v))
+					{
+						if (v.str) name = string_view(v.str);
+						else out.unresolved_names.push_back(make_pair(out.t.rows, d.off));
+					}
+					Dwarf_Off type = 0UL;
+					if ((c & scan_table::TYPE) && d.get_value(DW_AT_type, v))
+					{
+						switch (v.form)
+						{
+							case DW_FORM_ref1: case DW_FORM_ref2: case DW_FORM_ref4:
+							case DW_FORM_ref8: case DW_FORM_ref_udata: case DW_FORM_ref_addr:
+								type = v.u; // already section-relative
+								break;
+							default: break; // e.g. a type signature; no offset to give
+						}
+					}
+					Dwarf_Unsigned byte_size = scan_table::NO_BYTE_SIZE;
+					if ((c & scan_table::BYTE_SIZE) && d.get_value(DW_AT_byte_size, v))
+					{
+						switch (v.form)
+						{
+							case DW_FORM_data1: case DW_FORM_data2: case DW_FORM_data4:
+							case DW_FORM_data8: case DW_FORM_udata:
+								byte_size = v.u;
+								break;
+							case DW_FORM_sdata: case FORM_implicit_const:
+								if (v.s >= 0) byte_size = v.s;
+								break;
+							default: break; // a computed size; not a constant
+						}
+					}
+					out.add(d.off, parent, tag, i.depth(), name, type, byte_size);
+				}
+			}
+		}
+
+		void scan_table::append(const scan_table& arg)
+		{
+			name_ids ids;
+			for (unsigned i = 0; i < names.size(); ++i) ids.insert(make_pair(names[i], i));
+			merge(*this, ids, arg);
+		}
+
+		scan_table root_die::scan(unsigned columns,
+			std::function<bool(Dwarf_Off, Dwarf_Half, unsigned)> pred,
+			unsigned nthreads)
+		{
+			vector<unique_ptr<unit_scan> > results;
+			native_reader *p_native = native_reader_for_whole_file();
+			if (p_native)
+			{
+				/* The native reader is never modified, so any number of
+				 * threads can read through it; no need for concurrent
+				 * readers. */
+				if (nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+				const vector<native_reader::unit>& units = p_native->units();
+				for (unsigned i = 0; i < units.size(); ++i) results.emplace_back(new unit_scan(columns));
+				run_work_stealing(units.size(), [p_native, &units, &pred, &results](unsigned i, unsigned) {
+					scan_native_unit(*p_native, units[i], pred, *results[i]);
+				}, nthreads);
+			}
+			else
+			{
+				concurrent_section section;
+				vector<traversal_unit> units = prepare_parallel(false, nthreads, section);
+				for (unsigned i = 0; i < units.size(); ++i) results.emplace_back(new unit_scan(columns));
+				run_work_stealing(units.size(), [this, columns, &units, &pred, &results](unsigned i, unsigned) {
+					unit_scan& out = *results[i];
+					Dwarf_Off cu_offset = units[i].cu_offset;
+					for (iterator_df<> i_d = pos(cu_offset, 1); i_d != iterator_base::END; ++i_d)
+					{
+						if (i_d.offset_here() != cu_offset && i_d.depth() <= 1) break;
+						Dwarf_Off off = i_d.offset_here();
+						Dwarf_Half tag = i_d.tag_here();
+						Dwarf_Off parent = out.saw(off, i_d.depth());
+						if (pred && !pred(off, tag, i_d.depth())) continue;
+
+						opt<string_view> name = (columns & scan_table::NAME)
+							? i_d.name_view_here() : opt<string_view>();
+						Dwarf_Off type = 0UL;
+						Dwarf_Unsigned byte_size = scan_table::NO_BYTE_SIZE;
+						if (columns & (scan_table::TYPE | scan_table::BYTE_SIZE))
+						{
+							attribute_view attrs(i_d, *this);
+							if (columns & scan_table::TYPE)
+							{
+								encap::attribute_value v = attrs.get(DW_AT_type);
+								if (v.is_ref()) type = v.get_ref().off;
+							}
+							if (columns & scan_table::BYTE_SIZE)
+							{
+								encap::attribute_value v = attrs.get(DW_AT_byte_size);
+								if (v.is_unsigned() && v.get_signed() >= 0) byte_size = v.get_unsigned();
+							}
+						}
+						out.add(off, parent, tag, i_d.depth(), name, type, byte_size);
+					}
+				}, nthreads);
+			}
+
+			/* Concatenate in unit order, so rows come out depth-first. */
+			scan_table t(columns);
+			name_ids ids;
+			for (auto i_r = results.begin(); i_r != results.end(); ++i_r)
+			{
+				unsigned long base = t.rows;
+				merge(t, ids, (*i_r)->t);
+				/* Anything the native reader couldn't name, we ask libdwarf
+				 * about, back on the calling thread. */
+				for (auto i_u = (*i_r)->unresolved_names.begin();
+					i_u != (*i_r)->unresolved_names.end(); ++i_u)
+				{
+					auto name = name_view(find(i_u->second));
+					if (name) t.name[base + i_u->first] = intern(t, ids, *name);
+				}
+			}
+			return t;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/* dwarfpp: C++ binding for a useful subset of libdwarf, plus extra goodies.
+ *
+ * visit.cpp: depth-first visiting with pruning, without payloads
+ *
+ * Copyright (c) 2014, Stephen Kell.
+ */
+
+#include <deque>
+#include "lib.hpp"
+#include "native.hpp"
+
+namespace dwarf
+{
+	namespace core
+	{
+		using std::vector;
+		using std::pair;
+		using std::make_pair;
+
+		bool root_die::visit(std::function<visit_action(const visited_die&)> pre,
+			std::function<void(const visited_die&)> post)
+		{
+			native_reader *p_native = native_reader_for_whole_file();
+			if (p_native)
+			{
+				/* DIEs we've shown pre, but not yet post, innermost last.
+				 * Anything at or below the depth of the next DIE is done. */
+				vector< pair<native_die, unsigned> > open;
+				auto close_down_to = [this, &open, &post](unsigned depth) {
+					while (!open.empty() && open.back().second >= depth)
+					{
+						const native_die& d = open.back().first;
+						post(visited_die { *this, d.off, d.get_tag(), open.back().second, &d, nullptr });
+						open.pop_back();
+					}
+				};
+				native_iterator_df i = native_iterator_df::begin(*p_native);
+				while (!i.is_end())
+				{
+					const native_die& d = *i;
+					if (post) close_down_to(i.depth());
+					visit_action a = pre(visited_die { *this, d.off, d.get_tag(), i.depth(), &d, nullptr });
+					if (a == STOP) return false;
+					if (post) open.push_back(make_pair(d, i.depth()));
+					if (a == SKIP_SUBTREE) i.increment_skipping_subtree();
+					else ++i;
+				}
+				if (post) close_down_to(1);
+				return true;
+			}
+
+			/* The path from a CU down to where we are. Each step replaces
+			 * (by moving) or pops the last element, so we never copy an
+			 * iterator, and so never make a payload for one. A deque won't
+			 * move them as it grows. */
+			std::deque<iterator_base> path;
+			iterator_base first_cu = first_child(begin());
+			if (first_cu != iterator_base::END) path.push_back(std::move(first_cu));
+			while (!path.empty())
+			{
+				const iterator_base& cur = path.back();
+				visit_action a = pre(visited_die { *this, cur.offset_here(), cur.tag_here(),
+					cur.depth(), nullptr, &cur });
+				if (a == STOP) return false;
+				if (a == CONTINUE)
+				{
+					iterator_base child = first_child(cur);
+					if (child != iterator_base::END)
+					{
+						path.push_back(std::move(child));
+						continue;
+					}
+				}
+				/* Done with the back; climb until somebody has a next sibling. */
+				while (!path.empty())
+				{
+					iterator_base& done = path.back();
+					if (post) post(visited_die { *this, done.offset_here(), done.tag_here(),
+						done.depth(), nullptr, &done });
+					if (move_to_next_sibling(done)) break;
+					path.pop_back();
+				}
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout; 
+using std::endl;
+using namespace dwarf;
+using core::iterator_base;
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+
+	cout << "Building index with 4 threads..." << endl;
+	root.build_index(4);
+
+	/* Walk the whole tree, checking that the index agrees with what 
+	 * the iterators see: find() must give the same depth, and parent()
+	 * must be one level up. */
+	unsigned count = 0;
+	for (auto i = root.begin(); i != root.end(); ++i, ++count)
+	{
+		if (!i.is_real_die_position()) continue;
+		auto found = root.find(i.offset_here());
+		assert(found);
+		assert(found.depth() == i.depth());
+		auto parent = i.parent();
+		assert(parent.depth() + 1 == i.depth());
+		if (i.depth() > 1) assert(parent.offset_here() < i.offset_here());
+	}
+	cout << "Checked " << count << " DIEs." << endl;
+	assert(count > 0);
+	
+	return 0;
+}
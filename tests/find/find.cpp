@@ -0,0 +1,57 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using namespace dwarf;
+using core::iterator_df;
+
+struct expected_die
+{
+	Dwarf_Off off;
+	unsigned depth;
+	Dwarf_Off parent_off;
+};
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+
+	/* Some DIEs below the CUs' children, with their parents, the slow way. */
+	vector<expected_die> expected;
+	{
+		core::root_die root(fileno(in));
+		for (iterator_df<> i = root.begin(); i != root.end() && expected.size() < 200; ++i)
+		{
+			if (i.is_real_die_position() && i.depth() >= 3)
+			{
+				expected_die e = { i.offset_here(), i.depth(), root.parent(i).offset_here() };
+				expected.push_back(e);
+			}
+		}
+	}
+	assert(expected.size() > 0);
+
+	/* On a fresh root, find() each one and ask for its parent, twice (the
+	 * second time round is answered from what the first recorded). None
+	 * of this should need a CU's topology. */
+	core::root_die root(fileno(in));
+	for (unsigned round = 0; round < 2; ++round)
+	{
+		for (auto i_e = expected.begin(); i_e != expected.end(); ++i_e)
+		{
+			auto found = root.find(i_e->off);
+			assert(found);
+			assert(found.depth() == i_e->depth);
+			assert(root.parent(found).offset_here() == i_e->parent_off);
+			assert(!root.topology_containing(i_e->off));
+		}
+	}
+	cout << "Found " << expected.size() << " DIEs without a topology." << endl;
+
+	return 0;
+}
@@ -0,0 +1,115 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <iterator>
+#include <unistd.h>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using namespace dwarf;
+
+/* Where index.cpp's index_header keeps these. If that layout changes,
+ * INDEX_VERSION changes, and so must these. */
+const size_t FILE_LEN_AT = 88;
+const size_t NCUS_AT = 96;
+const size_t NNAMES_AT = 168;
+const size_t NAMES_POS_AT = 176;
+
+static vector<char> read_file(const string& path)
+{
+	std::ifstream in(path.c_str(), std::ios::binary);
+	return vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+static void write_file(const string& path, const vector<char>& bytes)
+{
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(&bytes[0], bytes.size());
+}
+static void put_u64(vector<char>& bytes, size_t at, uint64_t v)
+{ memcpy(&bytes[at], &v, sizeof v); }
+static uint64_t get_u64(const vector<char>& bytes, size_t at)
+{ uint64_t v; memcpy(&v, &bytes[at], sizeof v); return v; }
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	string path = string(argv[0]) + ".test-index";
+
+	{
+		core::root_die root(fileno(in));
+		if (!root.write_index(path))
+		{
+			cout << "Couldn't write an index (no build ID?); nothing to test." << endl;
+			return 0;
+		}
+	}
+
+	/* Round trip: a root that loads the index must agree with one that
+	 * doesn't, DIE for DIE. */
+	core::root_die fresh(fileno(in));
+	core::root_die loaded(fileno(in));
+	assert(loaded.load_index(path));
+	unsigned count = 0;
+	for (auto i = fresh.begin(); i != fresh.end(); ++i)
+	{
+		if (!i.is_real_die_position()) continue;
+		auto found = loaded.find(i.offset_here());
+		assert(found);
+		assert(found.depth() == i.depth());
+		assert(found.tag_here() == i.tag_here());
+		assert(loaded.parent(found).offset_here() == fresh.parent(i).offset_here());
+		++count;
+	}
+	cout << "Loaded index agreed on " << count << " DIEs." << endl;
+	assert(count > 0);
+
+	vector<char> good = read_file(path);
+	string bad_path = path + ".bad";
+
+	/* Truncated, with the length in the header patched to match, so only
+	 * the table bounds can give it away. */
+	vector<char> truncated(good.begin(), good.begin() + good.size() / 2);
+	put_u64(truncated, FILE_LEN_AT, truncated.size());
+	write_file(bad_path, truncated);
+	{
+		core::root_die root(fileno(in));
+		assert(!root.load_index(bad_path));
+	}
+
+	/* A CU count pointing way past the end. */
+	vector<char> bad_count = good;
+	put_u64(bad_count, NCUS_AT, (uint64_t) 1 << 40);
+	write_file(bad_path, bad_count);
+	{
+		core::root_die root(fileno(in));
+		assert(!root.load_index(bad_path));
+	}
+
+	/* A name whose DIE offset is just inside its DIE, and one that's
+	 * outside every CU. (The first field of a name entry is its DIE 
+	 * offset.) */
+	if (get_u64(good, NNAMES_AT) > 0)
+	{
+		size_t first_name_at = get_u64(good, NAMES_POS_AT);
+		uint64_t offsets[] = { get_u64(good, first_name_at) + 1, (uint64_t) -2 };
+		for (unsigned i = 0; i < 2; ++i)
+		{
+			vector<char> bad_name = good;
+			put_u64(bad_name, first_name_at, offsets[i]);
+			write_file(bad_path, bad_name);
+			core::root_die root(fileno(in));
+			assert(!root.load_index(bad_path));
+		}
+	}
+
+	unlink(bad_path.c_str());
+	unlink(path.c_str());
+	return 0;
+}
@@ -0,0 +1,68 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <sstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/native.hpp>
+
+using std::cout; 
+using std::endl;
+using namespace dwarf;
+using core::iterator_df;
+using core::native_iterator_df;
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+	core::native_reader *p_native = root.get_native_reader();
+	assert(p_native);
+
+	/* Walk the tree both ways in lockstep; they must agree on everything. */
+	unsigned count = 0;
+	native_iterator_df n = native_iterator_df::begin(*p_native);
+	for (iterator_df<> i = root.begin(); i != root.end(); ++i)
+	{
+		if (!i.is_real_die_position()) continue;
+		assert(!n.is_end());
+		assert(n->get_offset() == i.offset_here());
+		assert(n.depth() == i.depth());
+		assert(n->get_tag() == i.tag_here());
+		/* The CU table must agree with libdwarf and the native reader. */
+		assert(i.enclosing_cu_offset_here() == i.libdwarf_handle()->enclosing_cu_offset_here());
+		assert(i.enclosing_cu_offset_here() == n->get_enclosing_cu_offset());
+		assert(n->get_name() == i.name_here());
+		/* Name views come straight out of the mapped string bytes. */
+		auto view = i.name_view_here();
+		assert(!view == !i.name_here());
+		assert(!view || *view == *i.name_here());
+		assert(!view || view->data() == n->get_raw_name());
+		std::ostringstream s1, s2;
+		i.copy_attrs(root).print(s1, 0);
+		n->copy_attrs(root).print(s2, 0);
+		assert(s1.str() == s2.str());
+		/* A lazy view must decode to the same thing, in the same order
+		 * as the abbreviation lists them. */
+		core::attribute_view v(i, root);
+		encap::attribute_map from_view;
+		unsigned idx = 0;
+		for (auto i_a = v.begin(); i_a != v.end(); ++i_a, ++idx)
+		{
+			assert(i_a.attr() == n->p_abbrev->attrs[idx]);
+			assert(v.has(i_a.attr()));
+			from_view.insert(std::make_pair(i_a.attr(), i_a.value()));
+		}
+		assert(idx == v.size());
+		std::ostringstream s3;
+		from_view.print(s3, 0);
+		assert(s3.str() == s1.str());
+		++n;
+		++count;
+	}
+	assert(n.is_end());
+	cout << "Checked " << count << " DIEs." << endl;
+	assert(count > 0);
+	
+	return 0;
+}
@@ -0,0 +1,61 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <atomic>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout; 
+using std::endl;
+using std::vector;
+using namespace dwarf;
+using core::iterator_base;
+using core::iterator_df;
+using core::compile_unit_die;
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+
+	/* Sequentially first, before we go concurrent. */
+	vector<Dwarf_Off> seq;
+	for (auto i = root.begin(); i != root.end(); ++i)
+	{
+		if (i.is_real_die_position()) seq.push_back(i.offset_here());
+	}
+	cout << "Sequential walk saw " << seq.size() << " DIEs." << endl;
+	assert(seq.size() > 0);
+
+	/* The collected results must come out in depth-first order, 
+	 * however the units got scheduled. */
+	vector<Dwarf_Off> par = root.parallel_collect_dies<Dwarf_Off>(
+		[](const iterator_base& i) { return true; },
+		[](const iterator_base& i) { return i.offset_here(); },
+		4);
+	cout << "Parallel walk saw " << par.size() << " DIEs." << endl;
+	assert(par == seq);
+	/* We entered concurrent-reader mode just for that, so we must have
+	 * left it, and sequential-only queries work again. */
+	assert(!root.has_concurrent_readers());
+	root.scopes_at(0);
+	root.referrers_of(seq.front());
+
+	/* If we ask for the mode ourselves, it stays until we leave it. */
+	assert(root.enable_concurrent_readers(4));
+	std::atomic<unsigned> ncus(0);
+	root.parallel_for_each_cu([&ncus](const iterator_df<compile_unit_die>& i_cu) {
+		assert(i_cu.depth() == 1);
+		++ncus;
+	}, 4);
+	unsigned seq_ncus = 0;
+	auto cus = root.children();
+	for (auto i_cu = std::move(cus.first); i_cu != cus.second; ++i_cu) ++seq_ncus;
+	assert(ncus == seq_ncus);
+	cout << "Visited " << ncus << " CUs." << endl;
+	assert(root.has_concurrent_readers());
+	root.disable_concurrent_readers();
+	assert(!root.has_concurrent_readers());
+	
+	return 0;
+}
@@ -51,5 +51,21 @@ int main(int argc, char **argv)
 	results.clear();
 	r.resolve_all(main, path.begin(), path.end(), results);
 	assert(results.size() >= 1);
+	
+	// members by name, from the hash table, agree with the linear search
+	path = { "f", "S" };
+	results.clear();
+	r.resolve_all_visible_from_root(path.begin(), path.end(), results);
+	assert(results.size() >= 1);
+	auto s = results.at(0);
+	for (auto name : { "c", "u", "nonexistent" })
+	{
+		auto by_table = s.named_child(name);
+		auto by_scan = r.find_named_child(s, name);
+		assert((!by_table && !by_scan) || by_table.offset_here() == by_scan.offset_here());
+		// the table outlives the payload, if any
+		assert(r.find(s.offset_here()).named_child(name) == by_table);
+	}
+	assert(s.named_child("u").named_child("p"));
 
 }
@@ -0,0 +1,70 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using namespace dwarf;
+using core::iterator_df;
+using core::scan_table;
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+	core::root_die root(fileno(in));
+
+	/* Just the types, with everything we can ask for. */
+	auto is_type = [](Dwarf_Off off, Dwarf_Half tag, unsigned depth) {
+		return tag == DW_TAG_base_type || tag == DW_TAG_structure_type
+			|| tag == DW_TAG_pointer_type || tag == DW_TAG_typedef;
+	};
+	const unsigned columns = scan_table::OFFSET | scan_table::PARENT | scan_table::TAG
+		| scan_table::DEPTH | scan_table::NAME | scan_table::TYPE | scan_table::BYTE_SIZE;
+
+	/* The iterators must agree, row by row. */
+	auto check = [&root, &is_type](const scan_table& t) {
+		assert(t.offset.size() == t.size() && t.name.size() == t.size()
+			&& t.byte_size.size() == t.size());
+		unsigned long row = 0;
+		for (iterator_df<> i = root.begin(); i != root.end(); ++i)
+		{
+			if (!i.is_real_die_position() || !is_type(i.offset_here(), i.tag_here(), i.depth())) continue;
+			assert(row < t.size());
+			assert(t.offset[row] == i.offset_here());
+			assert(t.tag[row] == i.tag_here());
+			assert(t.depth[row] == i.depth());
+			assert(t.parent[row] == root.parent(i).offset_here());
+			auto name = i.name_here();
+			assert(!name == (t.name[row] == scan_table::NO_NAME));
+			assert(!name || t.names[t.name[row]] == *name);
+			auto type = i.attr(DW_AT_type);
+			assert(t.type[row] == (type.is_ref() ? type.get_ref().off : 0UL));
+			auto byte_size = i.attr(DW_AT_byte_size);
+			assert(t.byte_size[row] == ((byte_size.is_unsigned() && byte_size.get_signed() >= 0)
+				? byte_size.get_unsigned() : scan_table::NO_BYTE_SIZE));
+			++row;
+		}
+		assert(row == t.size());
+	};
+
+	/* With nothing in memory, this goes through the native reader. */
+	scan_table t = root.scan(columns, is_type);
+	cout << "Scan found " << t.size() << " types, with " << t.names.size()
+		<< " distinct names." << endl;
+	assert(t.size() > 0);
+	check(t);
+
+	/* Once there's an in-memory DIE, the native reader can't see 
+	 * everything, so we go the iterator (and attribute view) way. */
+	auto first_cu = root.first_child(root.begin());
+	auto created = root.make_new(first_cu, DW_TAG_base_type);
+	assert(created && created.depth() == 2);
+	scan_table t_iter = root.scan(columns, is_type);
+	cout << "Iterator scan found " << t_iter.size() << " types." << endl;
+	assert(t_iter.size() == t.size() + 1);
+	check(t_iter);
+
+	return 0;
+}
@@ -50,5 +50,20 @@ int main(int argc, char **argv)
 	}
 	assert(count >= 2);
 	
+	/* Children by number, and backwards, must agree with the forward walk. */
+	vector<Dwarf_Off> forwards;
+	for (auto i = children.first; i != children.second; ++i) forwards.push_back(i.offset_here());
+	assert(root.child_count(found) == forwards.size());
+	assert(root.nth_child(found, 1).offset_here() == forwards[1]);
+	assert(root.last_child(found).offset_here() == forwards.back());
+	assert(root.prev_sibling(root.nth_child(found, 1)).offset_here() == forwards[0]);
+	vector<Dwarf_Off> backwards;
+	for (auto i = children.second; i != children.first; )
+	{
+		--i;
+		backwards.push_back(i.offset_here());
+	}
+	assert(vector<Dwarf_Off>(backwards.rbegin(), backwards.rend()) == forwards);
+	
 	return 0;
 }
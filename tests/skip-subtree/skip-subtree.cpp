@@ -0,0 +1,54 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using namespace dwarf;
+using core::iterator_df;
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+
+	/* Everything down to depth 2, the slow way. */
+	vector< pair<Dwarf_Off, unsigned> > expected;
+	{
+		core::root_die root(fileno(in));
+		for (iterator_df<> i = root.begin(); i != root.end(); ++i)
+		{
+			if (i.is_real_die_position() && i.depth() <= 2)
+			{
+				expected.push_back(make_pair(i.offset_here(), i.depth()));
+			}
+		}
+	}
+
+	/* The same, skipping every subtree below the CUs' children, on a
+	 * fresh root so that nothing is known about the tree yet. */
+	vector< pair<Dwarf_Off, unsigned> > skipped;
+	core::root_die root(fileno(in));
+	iterator_df<> i = root.begin();
+	while (i != root.end())
+	{
+		if (i.is_real_die_position()) skipped.push_back(make_pair(i.offset_here(), i.depth()));
+		if (i.depth() >= 2) i.increment_skipping_subtree();
+		else ++i;
+	}
+	cout << "Skipping walk saw " << skipped.size() << " DIEs." << endl;
+	assert(skipped == expected);
+	assert(skipped.size() > 0);
+	/* Skipping (and climbing back out) must not have needed any CU's 
+	 * topology, which would have meant walking the whole CU. */
+	for (auto i_s = skipped.begin(); i_s != skipped.end(); ++i_s)
+	{
+		assert(!root.topology_containing(i_s->first));
+	}
+
+	return 0;
+}
@@ -0,0 +1,71 @@
+#undef NDEBUG // assert is part of our logic
+#include <fstream>
+#include <fileno.hpp>
+#include <dwarfpp/lib.hpp>
+#include <dwarfpp/native.hpp>
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::pair;
+using std::make_pair;
+using namespace dwarf;
+using core::iterator_df;
+using core::root_die;
+using core::visited_die;
+
+int main(int argc, char **argv)
+{
+	cout << "Opening " << argv[0] << "..." << endl;
+	std::ifstream in(argv[0]);
+
+	/* Everything, and everything down to depth 2, the slow way. */
+	vector< pair<Dwarf_Off, unsigned> > expected, expected_shallow;
+	{
+		root_die root(fileno(in));
+		for (iterator_df<> i = root.begin(); i != root.end(); ++i)
+		{
+			if (!i.is_real_die_position()) continue;
+			expected.push_back(make_pair(i.offset_here(), i.depth()));
+			if (i.depth() <= 2) expected_shallow.push_back(make_pair(i.offset_here(), i.depth()));
+		}
+	}
+
+	/* Visiting everything gives the same order, and post sees each DIE
+	 * once its children are done. */
+	root_die root(fileno(in));
+	vector< pair<Dwarf_Off, unsigned> > seen;
+	vector<Dwarf_Off> open;
+	unsigned long posted = 0;
+	bool finished = root.visit([&](const visited_die& d) {
+		assert(d.tag == d.iterator().tag_here());
+		seen.push_back(make_pair(d.offset, d.depth));
+		open.push_back(d.offset);
+		return root_die::CONTINUE;
+	}, [&](const visited_die& d) {
+		assert(!open.empty() && open.back() == d.offset);
+		open.pop_back();
+		++posted;
+	});
+	cout << "Visit saw " << seen.size() << " DIEs." << endl;
+	assert(finished);
+	assert(seen == expected);
+	assert(open.empty() && posted == seen.size());
+
+	/* Pruning below depth 2. */
+	vector< pair<Dwarf_Off, unsigned> > shallow;
+	root.visit([&](const visited_die& d) {
+		shallow.push_back(make_pair(d.offset, d.depth));
+		return (d.depth >= 2) ? root_die::SKIP_SUBTREE : root_die::CONTINUE;
+	});
+	assert(shallow == expected_shallow);
+
+	/* Stopping. */
+	unsigned long count = 0;
+	finished = root.visit([&](const visited_die& d) {
+		return (++count == 10) ? root_die::STOP : root_die::CONTINUE;
+	});
+	assert(!finished && count == 10);
+
+	return 0;
+}